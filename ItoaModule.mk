@@ -57,9 +57,11 @@ MODULE_SRC_FILES += \
     src/objc/objc-exception.m \
     src/objc/objc-exception-init.mm \
     src/objc/objc-loadmethod.m \
+    src/objc/objc-launch-cache.m \
     src/objc/objc-sel.mm \
     src/objc/objc-sel-set.m \
     src/objc/objc-references.mm \
+    src/objc/objc-autorelease.m \
     src/objc/objc-msg-arm.S \
     src/objc/objc-accessors.m \
     src/objc/Object.m \
@@ -67,10 +69,13 @@ MODULE_SRC_FILES += \
     \
     src/objc/android/objc-syslog.m \
     src/objc/android/dyld.m \
-    src/objc/android/sofcn.c \
     
 MODULE_LDLIBS := -llog -ldl
 MODULE_SHARED_LIBRARIES := macemu
     
 include $(BUILD_SHARED_LIBRARY)
 
+ifeq ($(OBJC_BUILD_BENCHMARKS),1)
+include $(MODULE_PATH)/bench/ItoaModule.mk
+endif
+
@@ -0,0 +1,41 @@
+#
+# Copyright (C) 2011 Dmitry Skiba
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Runtime benchmarks, one executable per file. Not built by default: 
+# set OBJC_BUILD_BENCHMARKS=1 and run the executables on the device.
+# cache_hash.c needs no runtime; build and run it on the host.
+
+MODULE_PATH := $(call my-dir)
+
+define objc-benchmark
+include $$(CLEAR_VARS)
+MODULE_NAME := objc-bench-$(1)
+MODULE_SRC_FILES := $(1).c
+MODULE_CFLAGS += -I$$(MODULE_PATH)/../include -O2
+MODULE_LDLIBS := -lpthread
+MODULE_SHARED_LIBRARIES := objc
+include $$(BUILD_EXECUTABLE)
+endef
+
+OBJC_BENCHMARKS := \
+    autorelease \
+    enumerate \
+    getclass \
+    msgsend_ic \
+    tagged \
+    vtable \
+
+$(foreach bench,$(OBJC_BENCHMARKS),$(eval $(call objc-benchmark,$(bench))))
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2011 Dmitry Skiba
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/***********************************************************************
+* autorelease.c
+* Autorelease pool push/pop and autorelease costs.
+*
+* Times an empty push/pop pair, then pools of 1, 16 and 4096 
+* autoreleased objects (the last spans several pool pages). Each 
+* object is retained before it is autoreleased, so the pop's release 
+* leaves it alive and the pool cost isn't mixed with deallocation.
+**********************************************************************/
+
+#include "bench.h"
+
+static void run(id obj, unsigned long pools, unsigned int perPool)
+{
+    char title[64];
+    unsigned long i;
+    unsigned int n;
+    uint64_t start;
+
+    start = bench_now();
+    for (i = 0; i < pools; i++) {
+        void *pool = objc_autoreleasePoolPush();
+        for (n = 0; n < perPool; n++) {
+            objc_autorelease(objc_retain(obj));
+        }
+        objc_autoreleasePoolPop(pool);
+    }
+    if (perPool == 0) {
+        bench_report("push + pop, empty pool", start, pools);
+    } else {
+        // Per object, including its share of the push and pop.
+        snprintf(title, sizeof(title), "retain + autorelease, %u per pool", 
+                 perPool);
+        bench_report(title, start, pools * perPool);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = bench_iterations(argc, argv, 4000000);
+    Class cls;
+    id obj;
+
+    cls = bench_makeClass("BenchAutorelease", Nil);
+    bench_initialize(cls);
+    obj = class_createInstance(cls, 0);
+
+    run(obj, iterations, 0);
+    run(obj, iterations, 1);
+    run(obj, iterations / 16, 16);
+    run(obj, iterations / 4096 + 1, 4096);
+
+    object_dispose(obj);
+    return 0;
+}
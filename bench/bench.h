@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2011 Dmitry Skiba
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/***********************************************************************
+* bench.h
+* Helpers shared by the runtime benchmarks in this directory.
+*
+* Each benchmark is a standalone C program linked against libobjc 
+* (see ItoaModule.mk). It builds the classes it needs with the runtime 
+* API, so no Objective-C compiler or Foundation is needed. The first 
+* argument, if any, overrides the iteration count.
+**********************************************************************/
+
+#ifndef _OBJC_BENCH_H
+#define _OBJC_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <objc/runtime.h>
+#include <objc/message.h>
+
+static inline uint64_t bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline unsigned long bench_iterations(int argc, char **argv, 
+                                             unsigned long fallback)
+{
+    if (argc > 1) return strtoul(argv[1], NULL, 0);
+    return fallback;
+}
+
+// Prints the time per operation for count operations started at start.
+static inline void bench_report(const char *name, uint64_t start, 
+                                unsigned long count)
+{
+    uint64_t elapsed = bench_now() - start;
+    printf("%-40s %8.2f ns/op  (%lu ops, %llu ms)\n", name, 
+           count ? (double)elapsed / count : 0.0, count, 
+           (unsigned long long)(elapsed / 1000000));
+}
+
+// Creates and registers a subclass of Object.
+static inline Class bench_makeClass(const char *name, Class superclass)
+{
+    Class cls;
+    if (!superclass) superclass = (Class)objc_getClass("Object");
+    cls = objc_allocateClassPair(superclass, name, 0);
+    if (!cls) {
+        fprintf(stderr, "could not create class %s\n", name);
+        exit(1);
+    }
+    objc_registerClassPair(cls);
+    return cls;
+}
+
+// Sends +class so that +initialize has run before anything is timed.
+static inline void bench_initialize(Class cls)
+{
+    objc_msgSend((id)cls, sel_registerName("class"));
+}
+
+#endif
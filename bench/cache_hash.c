@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2011 Dmitry Skiba
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/***********************************************************************
+* cache_hash.c
+* Probe length histograms for candidate method cache hashes.
+*
+* Fills simulated method caches the way _cache_fill does (linear 
+* probing, grow at 3/4 full) with selector addresses laid out like 
+* selector strings in __objc_methname (packed back to back) and like 
+* selectors registered at runtime (malloc'd, 8-byte aligned), then 
+* tallies probe lengths the way _cache_tallyProbes does. 
+* Needs no runtime; build and run it anywhere:
+*     cc -O2 -o cache_hash cache_hash.c && ./cache_hash
+**********************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The original objc-cache.m hash, a multiplicative hash that was 
+// tried and dropped, and the current CACHE_HASH.
+#define HASH_COUNT 3
+static const char *hashNames[HASH_COUNT] = {
+    "old hash (sel >> 2) & mask", 
+    "multiplicative hash (sel * 0x9e3779b1) >> 16", 
+    "current hash (sel >> 3) & mask", 
+};
+
+static uintptr_t hash(int kind, uintptr_t sel, uintptr_t mask)
+{
+    switch (kind) {
+    case 0: return (sel >> 2) & mask;
+    case 1: return (((uint32_t)sel * 0x9e3779b1U) >> 16) & mask;
+    default: return (sel >> 3) & mask;
+    }
+}
+
+#define SELECTOR_COUNT 8192
+#define CLASS_COUNT 2000
+#define HISTOGRAM_SIZE 17   // last bucket is 16+
+
+typedef struct {
+    unsigned long hits[HISTOGRAM_SIZE], misses[HISTOGRAM_SIZE];
+    unsigned long long hitProbes, missProbes, hitCount, missCount;
+} histogram;
+
+static uint32_t seed = 12345;
+static uint32_t rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static void tally(histogram *h, uintptr_t *buckets, uintptr_t mask, int kind)
+{
+    uintptr_t index;
+    for (index = 0; index <= mask; index++) {
+        uintptr_t missProbes = 1, index2 = index;
+        while (buckets[index2]  &&  missProbes <= mask) {
+            index2 = (index2 + 1) & mask;
+            missProbes++;
+        }
+        h->misses[missProbes < HISTOGRAM_SIZE ? missProbes : HISTOGRAM_SIZE-1]++;
+        h->missProbes += missProbes;
+        h->missCount++;
+        if (buckets[index]) {
+            uintptr_t home = hash(kind, buckets[index], mask);
+            uintptr_t hitProbes = ((index - home) & mask) + 1;
+            h->hits[hitProbes < HISTOGRAM_SIZE ? hitProbes : HISTOGRAM_SIZE-1]++;
+            h->hitProbes += hitProbes;
+            h->hitCount++;
+        }
+    }
+}
+
+// Fills one cache with sels[0..count) and tallies it at its fullest.
+static void fillCache(histogram *h, uintptr_t *sels, int count, int kind)
+{
+    uintptr_t mask = 3;
+    uintptr_t *buckets = calloc(mask + 1, sizeof(uintptr_t));
+    uintptr_t occupied = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        uintptr_t index;
+        if ((occupied + 1) * 4 > (mask + 1) * 3) {
+            // _cache_expand: tally the full cache, then double it
+            tally(h, buckets, mask, kind);
+            free(buckets);
+            mask = mask * 2 + 1;
+            buckets = calloc(mask + 1, sizeof(uintptr_t));
+            occupied = 0;
+        }
+        index = hash(kind, sels[i], mask);
+        while (buckets[index]) index = (index + 1) & mask;
+        buckets[index] = sels[i];
+        occupied++;
+    }
+    tally(h, buckets, mask, kind);
+    free(buckets);
+}
+
+static void print(const char *title, histogram *h)
+{
+    int i;
+    printf("%s\n", title);
+    printf("  avg probes: %.2f per hit, %.2f per miss\n", 
+           (double)h->hitProbes / h->hitCount, 
+           (double)h->missProbes / h->missCount);
+    for (i = 1; i < HISTOGRAM_SIZE; i++) {
+        printf("  %2d%s probes: %8lu hits %8lu misses\n", i, 
+               i == HISTOGRAM_SIZE-1 ? "+" : " ", h->hits[i], h->misses[i]);
+    }
+}
+
+static void run(const char *layout, uintptr_t *pool)
+{
+    histogram h[HASH_COUNT];
+    uintptr_t sels[256];
+    int c, k;
+    char title[128];
+
+    memset(h, 0, sizeof(h));
+    seed = 12345;
+    for (c = 0; c < CLASS_COUNT; c++) {
+        // Most classes send few selectors; some send many.
+        int count = 2 + rnd() % (rnd() % 8 ? 24 : 200);
+        int i;
+        // Half the selectors are a class's own methods, which sit 
+        // together in __objc_methname; half are shared ones.
+        uint32_t run = rnd() % (SELECTOR_COUNT - count);
+        for (i = 0; i < count; i++) {
+            int j;
+            sels[i] = (i % 2) ? pool[run + i] : pool[rnd() % SELECTOR_COUNT];
+            // no duplicates in a cache: retry with a shared selector
+            for (j = 0; j < i; j++) {
+                if (sels[j] == sels[i]) {
+                    sels[i] = pool[rnd() % SELECTOR_COUNT];
+                    j = -1;
+                }
+            }
+        }
+        for (k = 0; k < HASH_COUNT; k++) {
+            fillCache(&h[k], sels, count, k);
+        }
+    }
+    for (k = 0; k < HASH_COUNT; k++) {
+        snprintf(title, sizeof(title), "%s, %s:", layout, hashNames[k]);
+        print(title, &h[k]);
+    }
+}
+
+int main(void)
+{
+    static uintptr_t pool[SELECTOR_COUNT];
+    uintptr_t addr;
+    int i;
+
+    // Selector strings packed in __objc_methname: 4 to 40 bytes each.
+    seed = 1;
+    addr = 0x40000;
+    for (i = 0; i < SELECTOR_COUNT; i++) {
+        pool[i] = addr;
+        addr += 5 + rnd() % 36;
+    }
+    run("packed __objc_methname strings", pool);
+
+    // Selectors registered at runtime: malloc'd copies, 8-byte aligned, 
+    // mostly 16 or 32 bytes apart.
+    seed = 2;
+    addr = 0x800000;
+    for (i = 0; i < SELECTOR_COUNT; i++) {
+        pool[i] = addr;
+        addr += (rnd() % 4) ? 16 : 32;
+    }
+    printf("\n");
+    run("malloc'd selector names", pool);
+    return 0;
+}
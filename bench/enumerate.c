@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2011 Dmitry Skiba
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/***********************************************************************
+* enumerate.c
+* Enumeration APIs against the copying ones.
+*
+* Counts a class's methods with class_enumerateMethods and with 
+* class_copyMethodList + free, and all classes with 
+* objc_enumerateClasses and with objc_getClassList into a malloc'd 
+* buffer, the way reflection code typically does it.
+**********************************************************************/
+
+#include "bench.h"
+
+#define METHOD_COUNT 64
+#define CLASS_COUNT 256
+
+static int valueIMP(id self, SEL _cmd) 
+{
+    return 1;
+}
+
+static BOOL countMethod(Method m, void *context)
+{
+    if (method_getName(m)) ++*(unsigned int *)context;
+    return YES;
+}
+
+static BOOL countClass(Class cls, void *context)
+{
+    if (cls) ++*(unsigned int *)context;
+    return YES;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = bench_iterations(argc, argv, 200000);
+    unsigned long classIterations = iterations / 100 + 1;
+    unsigned long i;
+    unsigned int seen = 0, expected = 0;
+    uint64_t start;
+    Class cls;
+    int n;
+
+    cls = bench_makeClass("BenchEnumerate", Nil);
+    for (n = 0; n < METHOD_COUNT; n++) {
+        char name[32];
+        snprintf(name, sizeof(name), "method%d", n);
+        class_addMethod(cls, sel_registerName(name), (IMP)valueIMP, "i@:");
+    }
+    for (n = 0; n < CLASS_COUNT; n++) {
+        char name[32];
+        snprintf(name, sizeof(name), "BenchEnumerate%d", n);
+        bench_makeClass(name, cls);
+    }
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        class_enumerateMethods(cls, countMethod, &seen);
+    }
+    bench_report("class_enumerateMethods", start, iterations);
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        unsigned int count, m;
+        Method *methods = class_copyMethodList(cls, &count);
+        for (m = 0; m < count; m++) {
+            if (method_getName(methods[m])) expected++;
+        }
+        free(methods);
+    }
+    bench_report("class_copyMethodList + free", start, iterations);
+
+    start = bench_now();
+    for (i = 0; i < classIterations; i++) {
+        objc_enumerateClasses(countClass, &seen);
+    }
+    bench_report("objc_enumerateClasses", start, classIterations);
+
+    start = bench_now();
+    for (i = 0; i < classIterations; i++) {
+        int count = objc_getClassList(NULL, 0), c;
+        Class *classes = malloc(count * sizeof(Class));
+        count = objc_getClassList(classes, count);
+        for (c = 0; c < count; c++) {
+            if (classes[c]) expected++;
+        }
+        free(classes);
+    }
+    bench_report("objc_getClassList + malloc + free", start, 
+                 classIterations);
+
+    if (seen != expected) {
+        fprintf(stderr, "enumerated %u entries, copied %u\n", seen, expected);
+        return 1;
+    }
+    return 0;
+}
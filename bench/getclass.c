@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2011 Dmitry Skiba
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/***********************************************************************
+* getclass.c
+* Concurrent objc_getClass benchmark.
+*
+* Registers CLASS_COUNT classes, then looks them up by name from 1, 2, 
+* 4 and 8 threads at once. Lookups take no lock, so time per lookup 
+* should stay flat as threads are added (up to the number of cores).
+* Names are looked up from copies, so pointer-equal fast paths in the 
+* table don't flatter the result.
+**********************************************************************/
+
+#include "bench.h"
+#include <pthread.h>
+#include <string.h>
+
+#define CLASS_COUNT 512
+#define MAX_THREADS 8
+
+static char *names[CLASS_COUNT];
+static unsigned long iterations;
+static volatile int failures;
+
+static void *lookUpClasses(void *arg)
+{
+    unsigned long i;
+    unsigned int n = (unsigned int)(uintptr_t)arg;
+    for (i = 0; i < iterations; i++) {
+        if (!objc_getClass(names[n])) failures++;
+        n = (n + 7) % CLASS_COUNT;
+    }
+    return NULL;
+}
+
+static void run(int threadCount)
+{
+    pthread_t threads[MAX_THREADS];
+    char title[64];
+    uint64_t start;
+    int t;
+
+    start = bench_now();
+    for (t = 0; t < threadCount; t++) {
+        pthread_create(&threads[t], NULL, lookUpClasses, 
+                       (void *)(uintptr_t)(t * 31 % CLASS_COUNT));
+    }
+    for (t = 0; t < threadCount; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    // Wall time per lookup per thread: flat means no contention.
+    snprintf(title, sizeof(title), "objc_getClass, %d thread%s", 
+             threadCount, threadCount == 1 ? "" : "s");
+    bench_report(title, start, iterations);
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    iterations = bench_iterations(argc, argv, 2000000);
+
+    for (i = 0; i < CLASS_COUNT; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "BenchClass%d", i);
+        bench_makeClass(name, Nil);
+        names[i] = strdup(name);
+    }
+
+    for (i = 1; i <= MAX_THREADS; i *= 2) {
+        run(i);
+    }
+
+    if (failures) {
+        fprintf(stderr, "%d lookups failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
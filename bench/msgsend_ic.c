@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2011 Dmitry Skiba
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/***********************************************************************
+* msgsend_ic.c
+* objc_msgSend_ic against objc_msgSend.
+*
+* Monomorphic: one call site always sees the same class. 
+* Polymorphic: one call site sees four classes in turn; the slot keeps 
+* the first, the others go through the method cache.
+* objc_msgLookup is timed too, with the IMP looked up on every send.
+**********************************************************************/
+
+#include "bench.h"
+
+#define CLASS_COUNT 4
+
+static int valueIMP(id self, SEL _cmd) 
+{
+    return 1;
+}
+
+typedef int (*value_fn)(id, SEL);
+typedef int (*value_ic_fn)(id, objc_ic_slot *);
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = bench_iterations(argc, argv, 20000000);
+    SEL value = sel_registerName("value");
+    objc_ic_slot monoSlot = { value };
+    objc_ic_slot polySlot = { value };
+    id objects[CLASS_COUNT];
+    unsigned long i;
+    uint64_t start;
+    int sum = 0;
+    int c;
+
+    for (c = 0; c < CLASS_COUNT; c++) {
+        char name[32];
+        Class cls;
+        snprintf(name, sizeof(name), "BenchIC%d", c);
+        cls = bench_makeClass(name, Nil);
+        class_addMethod(cls, value, (IMP)valueIMP, "i@:");
+        bench_initialize(cls);
+        objects[c] = class_createInstance(cls, 0);
+    }
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        sum += ((value_fn)objc_msgSend)(objects[0], value);
+    }
+    bench_report("objc_msgSend, monomorphic", start, iterations);
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        sum += ((value_ic_fn)objc_msgSend_ic)(objects[0], &monoSlot);
+    }
+    bench_report("objc_msgSend_ic, monomorphic", start, iterations);
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        id obj = objects[0];
+        sum += ((value_fn)objc_msgLookup(obj, value))(obj, value);
+    }
+    bench_report("objc_msgLookup + call, monomorphic", start, iterations);
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        sum += ((value_fn)objc_msgSend)(objects[i % CLASS_COUNT], value);
+    }
+    bench_report("objc_msgSend, polymorphic", start, iterations);
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        sum += ((value_ic_fn)objc_msgSend_ic)(objects[i % CLASS_COUNT], 
+                                              &polySlot);
+    }
+    bench_report("objc_msgSend_ic, polymorphic", start, iterations);
+
+    return sum == (int)(iterations * 5) ? 0 : 1;
+}
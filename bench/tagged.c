@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2011 Dmitry Skiba
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/***********************************************************************
+* tagged.c
+* Boxed numbers: heap objects against tagged pointers.
+*
+* Boxes each of a range of small integers and sends -intValue to the 
+* box, once as a heap object made with class_createInstance and freed 
+* with object_dispose, once as a tagged pointer. Heap boxes cost one 
+* allocation each; tagged boxes cost none. Sends to ready-made boxes 
+* are timed separately, to show the dispatch cost of tagged receivers.
+**********************************************************************/
+
+#include "bench.h"
+#include <objc/objc-internal.h>
+
+#define TAG_SLOT 3
+
+static int heapIntValue(id self, SEL _cmd)
+{
+    return *(int *)object_getIndexedIvars(self);
+}
+
+static int taggedIntValue(id self, SEL _cmd)
+{
+    return (int)_objc_getTaggedPointerSignedValue(self);
+}
+
+typedef int (*int_fn)(id, SEL);
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = bench_iterations(argc, argv, 10000000);
+    SEL intValue = sel_registerName("intValue");
+    unsigned long i, allocations = 0;
+    long long heapSum = 0, taggedSum = 0;
+    Class heapClass, taggedClass;
+    id heapBox, taggedBox;
+    uint64_t start;
+
+    heapClass = bench_makeClass("BenchHeapNumber", Nil);
+    class_addMethod(heapClass, intValue, (IMP)heapIntValue, "i@:");
+    bench_initialize(heapClass);
+
+    taggedClass = bench_makeClass("BenchTaggedNumber", Nil);
+    class_addMethod(taggedClass, intValue, (IMP)taggedIntValue, "i@:");
+    bench_initialize(taggedClass);
+    _objc_insert_tagged_isa(TAG_SLOT, taggedClass);
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        id box = class_createInstance(heapClass, sizeof(int));
+        allocations++;
+        *(int *)object_getIndexedIvars(box) = (int)(i & 0xffff);
+        heapSum += ((int_fn)objc_msgSend)(box, intValue);
+        object_dispose(box);
+    }
+    bench_report("heap box + send + dispose", start, iterations);
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        id box = _objc_makeTaggedPointer(TAG_SLOT, i & 0xffff);
+        taggedSum += ((int_fn)objc_msgSend)(box, intValue);
+    }
+    bench_report("tagged box + send", start, iterations);
+    printf("allocations: %lu heap, 0 tagged\n", allocations);
+
+    heapBox = class_createInstance(heapClass, sizeof(int));
+    *(int *)object_getIndexedIvars(heapBox) = 1;
+    taggedBox = _objc_makeTaggedPointer(TAG_SLOT, 1);
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        heapSum += ((int_fn)objc_msgSend)(heapBox, intValue);
+    }
+    bench_report("send to heap box", start, iterations);
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        taggedSum += ((int_fn)objc_msgSend)(taggedBox, intValue);
+    }
+    bench_report("send to tagged box", start, iterations);
+
+    object_dispose(heapBox);
+    return heapSum == taggedSum ? 0 : 1;
+}
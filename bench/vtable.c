@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2011 Dmitry Skiba
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/***********************************************************************
+* vtable.c
+* Vtable sends against cached sends.
+*
+* Sends go through message refs the way __objc_msgrefs call sites do: 
+* the caller loads ref->imp and passes the ref in place of the 
+* selector. -count is a vtable selector, so its ref is rewritten to a 
+* vtable trampoline on the first send. -value is not, so its ref ends 
+* up at objc_msgSend_fixedup and the method cache. Plain objc_msgSend 
+* of -count is timed for comparison.
+**********************************************************************/
+
+#include "bench.h"
+
+typedef struct {
+    IMP imp;
+    SEL sel;
+} message_ref;
+
+OBJC_EXPORT id objc_msgSend_fixup(id self, message_ref *msg, ...);
+
+static int valueIMP(id self, SEL _cmd) 
+{
+    return 1;
+}
+
+typedef int (*value_fn)(id, SEL);
+typedef int (*value_ref_fn)(id, message_ref *);
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = bench_iterations(argc, argv, 20000000);
+    message_ref countRef = { (IMP)objc_msgSend_fixup, (SEL)"count" };
+    message_ref valueRef = { (IMP)objc_msgSend_fixup, (SEL)"value" };
+    SEL count = sel_registerName("count");
+    unsigned long i;
+    uint64_t start;
+    Class cls;
+    id obj;
+    int sum = 0;
+
+    cls = bench_makeClass("BenchVtable", Nil);
+    class_addMethod(cls, count, (IMP)valueIMP, "i@:");
+    class_addMethod(cls, sel_registerName("value"), (IMP)valueIMP, "i@:");
+    bench_initialize(cls);
+    obj = class_createInstance(cls, 0);
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        sum += ((value_ref_fn)countRef.imp)(obj, &countRef);
+    }
+    bench_report("vtable send (-count)", start, iterations);
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        sum += ((value_ref_fn)valueRef.imp)(obj, &valueRef);
+    }
+    bench_report("fixed-up cached send (-value)", start, iterations);
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        sum += ((value_fn)objc_msgSend)(obj, count);
+    }
+    bench_report("objc_msgSend (-count)", start, iterations);
+
+    return sum == (int)(iterations * 3) ? 0 : 1;
+}
@@ -121,6 +121,57 @@ OBJC_EXPORT id _objc_msgForward(id receiver, SEL sel, ...);
 OBJC_EXPORT void _objc_msgForward_stret(id receiver, SEL sel, ...);
 
 
+/* Two-phase Messaging Primitives
+ * Use these functions to find the IMP that objc_msgSend would call 
+ * without calling it. Call the result with the original receiver and 
+ * selector (for the super variants, super->receiver and selector).
+ * Use the _stret variants for methods sent with objc_msgSend_stret.
+ *
+ * The result is never NULL. A nil receiver yields an IMP that returns 
+ * zero. An unrecognized selector yields _objc_msgForward or 
+ * _objc_msgForward_stret.
+ *
+ * Callers may keep the result only while objc_methodGeneration is 
+ * unchanged. The runtime increments it whenever method caches are 
+ * flushed or a method's implementation changes.
+ *
+ * The results must be cast to an appropriate function pointer type 
+ * before being called. 
+ */
+OBJC_EXPORT IMP objc_msgLookup(id self, SEL op);
+OBJC_EXPORT IMP objc_msgLookup_stret(id self, SEL op);
+OBJC_EXPORT IMP objc_msgLookupSuper(struct objc_super *super, SEL op);
+OBJC_EXPORT IMP objc_msgLookupSuper_stret(struct objc_super *super, SEL op);
+OBJC_EXPORT volatile uint32_t objc_methodGeneration;
+
+
+/* Inline-cached Messaging Primitive
+ * objc_msgSend_ic sends slot->sel to self, like objc_msgSend, using a 
+ * call-site cache. The slot is passed in place of the selector, and 
+ * the method receives slot->sel as its _cmd. Each call site needs its 
+ * own static slot, initialized with only the selector set:
+ *
+ *     static objc_ic_slot slot = { @selector(count) };
+ *     n = ((NSUInteger(*)(id, objc_ic_slot *))objc_msgSend_ic)(array, &slot);
+ *
+ * The slot remembers the first receiver class and its IMP. Sends to 
+ * that class skip the method cache. Sends to other classes use the 
+ * method cache as objc_msgSend does. The slot is refilled after 
+ * objc_methodGeneration changes.
+ *
+ * Do not use objc_msgSend_ic for methods that need objc_msgSend_stret.
+ * The slot contents are private to the runtime.
+ */
+typedef struct objc_ic_slot {
+    SEL sel;
+    Class cls;
+    IMP imp;
+    uint32_t generation;
+} objc_ic_slot;
+
+OBJC_EXPORT id objc_msgSend_ic(id self, objc_ic_slot *slot, ...);
+
+
 /* Variable-argument Messaging Primitives
  *
  * Use these functions to call methods with a list of arguments, such 
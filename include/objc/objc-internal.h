@@ -26,6 +26,7 @@
 #ifndef _OBJC_INTERNAL_H
 #define _OBJC_INTERNAL_H
 
+#include <stdint.h>
 #include <objc/objc.h>
 
 OBJC_EXPORT id objc_constructInstance(Class cls, void *bytes);
@@ -33,4 +34,48 @@ OBJC_EXPORT void *objc_destructInstance(id obj);
 
 OBJC_EXPORT void objc_environ_init(void);
 
+/* Root retain/release. A root class that keeps its reference count in 
+ * the runtime implements -retain, -release, -autorelease and 
+ * -retainCount with these; objc_retain() and friends then skip message 
+ * dispatch for it and every subclass that doesn't override them. 
+ * _objc_rootRelease sends -dealloc when the count drops to zero. 
+ * _objc_rootAutorelease adds to the objc_autoreleasePoolPush() pools. */
+OBJC_EXPORT id _objc_rootRetain(id obj, SEL _cmd);
+OBJC_EXPORT void _objc_rootRelease(id obj, SEL _cmd);
+OBJC_EXPORT id _objc_rootAutorelease(id obj, SEL _cmd);
+OBJC_EXPORT uintptr_t _objc_rootRetainCount(id obj, SEL _cmd);
+
+/* Tagged pointers. An id with the low bit set is not a pointer to an 
+ * object: bits 1-3 select one of 8 registered classes and the upper 
+ * 28 bits are the payload. Messages to it are dispatched to the slot's 
+ * class; retain and release are no-ops. Real objects are 8-byte aligned, 
+ * so they never look tagged. Each slot can be registered only once. */
+#define _OBJC_TAG_MASK 1
+#define _OBJC_TAG_SLOT_SHIFT 1
+#define _OBJC_TAG_SLOT_COUNT 8
+#define _OBJC_TAG_PAYLOAD_SHIFT 4
+
+OBJC_EXPORT void _objc_insert_tagged_isa(unsigned char slotNumber, Class isa);
+
+static __inline BOOL _objc_isTaggedPointer(const void *ptr) {
+    return ((uintptr_t)ptr & _OBJC_TAG_MASK) ? YES : NO;
+}
+
+static __inline id _objc_makeTaggedPointer(unsigned int slot, uintptr_t value) {
+    return (id)((value << _OBJC_TAG_PAYLOAD_SHIFT) | 
+                (slot << _OBJC_TAG_SLOT_SHIFT) | _OBJC_TAG_MASK);
+}
+
+static __inline unsigned int _objc_getTaggedPointerSlot(const void *ptr) {
+    return ((uintptr_t)ptr >> _OBJC_TAG_SLOT_SHIFT) & (_OBJC_TAG_SLOT_COUNT - 1);
+}
+
+static __inline uintptr_t _objc_getTaggedPointerValue(const void *ptr) {
+    return (uintptr_t)ptr >> _OBJC_TAG_PAYLOAD_SHIFT;
+}
+
+static __inline intptr_t _objc_getTaggedPointerSignedValue(const void *ptr) {
+    return (intptr_t)ptr >> _OBJC_TAG_PAYLOAD_SHIFT;
+}
+
 #endif
@@ -110,6 +110,58 @@ OBJC_EXPORT Protocol **class_copyProtocolList(Class cls, unsigned int *outCount)
 OBJC_EXPORT objc_property_t class_getProperty(Class cls, const char *name);
 OBJC_EXPORT objc_property_t *class_copyPropertyList(Class cls, unsigned int *outCount);
 
+/* Allocation-free variants of objc_getClassList and class_copy*List. 
+ * The function is called for each entry, in the same order as the 
+ * copying call, until it returns NO. The result is the number of 
+ * entries visited. 
+ * The function runs without runtime locks held and may call into the 
+ * runtime or send messages. Entries added while an enumeration runs 
+ * may or may not be visited; objc_enumerateClasses may also visit a 
+ * class twice, or miss one, if classes are added or removed meanwhile. 
+ * The class being enumerated must not be disposed of. */
+typedef BOOL (*objc_class_enumerator)(Class cls, void *context);
+typedef BOOL (*objc_method_enumerator)(Method m, void *context);
+typedef BOOL (*objc_ivar_enumerator)(Ivar ivar, void *context);
+typedef BOOL (*objc_property_enumerator)(objc_property_t property, void *context);
+typedef BOOL (*objc_protocol_enumerator)(Protocol *protocol, void *context);
+
+OBJC_EXPORT unsigned int objc_enumerateClasses(objc_class_enumerator function, void *context);
+OBJC_EXPORT unsigned int class_enumerateMethods(Class cls, objc_method_enumerator function, void *context);
+OBJC_EXPORT unsigned int class_enumerateIvars(Class cls, objc_ivar_enumerator function, void *context);
+OBJC_EXPORT unsigned int class_enumerateProperties(Class cls, objc_property_enumerator function, void *context);
+OBJC_EXPORT unsigned int class_enumerateProtocols(Class cls, objc_protocol_enumerator function, void *context);
+
+/* Freezing the runtime declares that no more classes, categories, methods 
+ * or protocols will be added or changed (typically once all plugins are 
+ * loaded). All classes are realized and their categories attached; after 
+ * that method lookup, class, protocol and selector lookup and the other 
+ * read-only queries run without taking the runtime locks. 
+ * While frozen, mutating calls (class_addMethod, method_setImplementation, 
+ * objc_allocateClassPair, ...) fail and log, and loading or unloading an 
+ * Objective-C image is fatal. objc_unfreezeRuntime() re-enables them; it 
+ * must only be called while no other thread is using the runtime. */
+OBJC_EXPORT void objc_freezeRuntime(void);
+OBJC_EXPORT void objc_unfreezeRuntime(void);
+OBJC_EXPORT BOOL objc_isRuntimeFrozen(void);
+
+/* Warm-up for prefork servers: call objc_prepareForFork() in the parent 
+ * so the metadata writes children would each make land on pages they 
+ * share copy-on-write. All classes are realized and their categories 
+ * attached. OBJC_FORK_INITIALIZE also sends +initialize to every class. 
+ * OBJC_FORK_FILL_CACHES also fills the method caches of initialized 
+ * classes with the selectors listed in the file named by 
+ * OBJC_FORK_SELECTORS (same format as OBJC_VTABLE_SELECTORS). 
+ * objc_printForkSharing() logs how much of the Objective-C images' and 
+ * the heap's memory is shared or private in the calling process; call 
+ * it in a child once it has served some requests. */
+enum {
+    OBJC_FORK_INITIALIZE = 1 << 0,
+    OBJC_FORK_FILL_CACHES = 1 << 1
+};
+
+OBJC_EXPORT void objc_prepareForFork(unsigned int flags);
+OBJC_EXPORT void objc_printForkSharing(void);
+
 OBJC_EXPORT const char *class_getIvarLayout(Class cls);
 OBJC_EXPORT const char *class_getWeakIvarLayout(Class cls);
 
@@ -196,6 +248,39 @@ OBJC_EXPORT void objc_setAssociatedObject(id object, void *key, id value, objc_A
 OBJC_EXPORT id objc_getAssociatedObject(id object, void *key);
 OBJC_EXPORT void objc_removeAssociatedObjects(id object);
 
+/* Reference counting without message dispatch. For instances of classes 
+ * that use the root implementations (see _objc_rootRetain in 
+ * objc-internal.h) and don't override them, these adjust the count 
+ * directly; otherwise they send -retain, -release or -autorelease. 
+ * All of them do nothing and return nil when given nil. */
+OBJC_EXPORT id objc_retain(id obj);
+OBJC_EXPORT void objc_release(id obj);
+OBJC_EXPORT id objc_autorelease(id obj);
+OBJC_EXPORT id objc_retainAutorelease(id obj);
+
+/* Autorelease pools. objc_autoreleasePoolPush() returns a token for 
+ * objc_autoreleasePoolPop(), which releases every object autoreleased 
+ * on this thread since the push. Pools nest and must be popped on the 
+ * thread that pushed them; popping an outer pool pops inner ones too. */
+OBJC_EXPORT void *objc_autoreleasePoolPush(void);
+OBJC_EXPORT void objc_autoreleasePoolPop(void *token);
+
+/* Zeroing weak references. A weak variable is a location registered 
+ * with the runtime; it is set to nil when its object is deallocated. 
+ * Initialize one with objc_initWeak(), assign with objc_storeWeak(), 
+ * read with objc_loadWeakRetained() (which returns a retained object, 
+ * or nil if it is already deallocating), and unregister it with 
+ * objc_destroyWeak() before its memory goes away. 
+ * Classes with their own retain/release must implement 
+ * -allowsWeakReference and -retainWeakReference, which return NO once 
+ * an instance is deallocating (-retainWeakReference retains it 
+ * otherwise); storing an instance of any other such class stores nil. */
+OBJC_EXPORT id objc_initWeak(id *location, id obj);
+OBJC_EXPORT id objc_storeWeak(id *location, id obj);
+OBJC_EXPORT id objc_loadWeakRetained(id *location);
+OBJC_EXPORT id objc_loadWeak(id *location);
+OBJC_EXPORT void objc_destroyWeak(id *location);
+
 
 #define _C_ID       '@'
 #define _C_CLASS    '#'
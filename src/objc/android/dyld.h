@@ -31,6 +31,7 @@
 #define MH_DYLIB 0
 #define MH_BUNDLE 1
 
+#define SEG_TEXT "SEG_TEXT"
 #define SEG_DATA "SEG_DATA"
 #define SECT_OBJC_MODULES "SECT_OBJC_MODULES"
 
@@ -39,11 +40,35 @@
 #define RTLD_NOLOAD 0
 #define RTLD_FIRST 0
 
+/* Objective-C sections of an ELF image, located once when the image
+ *  is registered (see call_dyld_handlers).
+ */
+enum dyld_section_index {
+    DYLD_SECT_IMAGEINFO,
+    DYLD_SECT_CLASSLIST,
+    DYLD_SECT_NLCLSLIST,
+    DYLD_SECT_CATLIST,
+    DYLD_SECT_NLCATLIST,
+    DYLD_SECT_PROTOLIST,
+    DYLD_SECT_PROTOREFS,
+    DYLD_SECT_CLASSREFS,
+    DYLD_SECT_SUPERREFS,
+    DYLD_SECT_SELREFS,
+    DYLD_SECT_MSGREFS,
+    DYLD_SECT_COUNT
+};
+
+struct dyld_section {
+    char* start;
+    uint32_t size;
+};
+
 struct mach_header {
     uint32_t magic;
     uint32_t ncmds;
     uint32_t filetype;
     void* handle;
+    struct dyld_section sections[DYLD_SECT_COUNT];
 };
 
 struct segment_command {
@@ -99,6 +124,33 @@ void dyld_register_image_state_change_handler(
 const char* dyld_image_path_containing_address(
     const void* addr);
 
+/* Not in real dyld: returns image's path as reported by the loader,
+ *  or "" for the main executable. The string lives as long as the image.
+ */
+const char* dyld_image_name(
+    const struct mach_header* mh);
+
+/* Not in real dyld: returns image's GNU build-id note (NT_GNU_BUILD_ID),
+ *  or NULL if the image doesn't have one.
+ */
+const uint8_t* dyld_image_build_id(
+    const struct mach_header* mh,
+    uint32_t* length);
+
+/* Not in real dyld: returns PROT_* flags the range [addr, addr+size)
+ *  is currently mapped with, or -1 if the range doesn't lie within
+ *  one PT_LOAD segment of the image (or straddles PT_GNU_RELRO).
+ *  Ranges inside PT_GNU_RELRO are reported as read-only: the loader
+ *  protects them after relocation, before any handler runs. Such a
+ *  range is only reported if every page it touches lies within
+ *  PT_GNU_RELRO rounded down to pages, so the caller may change the
+ *  protection of those pages as a whole.
+ */
+int dyld_image_protection(
+    const struct mach_header* mh,
+    const void* addr,
+    uint32_t size);
+
 
 #endif // _DYLD_INCLUDED_
 
@@ -15,10 +15,37 @@
  */
 
 #import "dyld.h"
-#import "sofcn.h"
 #import "objc-private.h"
+#import "objc-launch-cache.h"
+#import <linux/elf.h>
+#import <link.h>
+
+#ifndef NT_GNU_BUILD_ID
+#define NT_GNU_BUILD_ID 3
+#endif
+
+#ifndef PT_GNU_RELRO
+#define PT_GNU_RELRO 0x6474e552
+#endif
 
 dyld_image_state_change_handler dyld_handlers[DYLD_IMAGE_STATE_COUNT]={0};
+static bool dyld_handler_batch[DYLD_IMAGE_STATE_COUNT]={0};
+
+/* Image as seen by dl_iterate_phdr. Header must be first: handlers
+ *  get &image->header, and mach_header.handle points back here.
+ * The text segment spans the fake header itself (so the slide is 0 and
+ *  section addresses are used as is), the data segment spans the
+ *  image's mapped PT_LOAD range.
+ */
+struct dyld_image {
+    struct mach_header header;
+    struct segment_command text;
+    struct segment_command data;
+    const char* name;
+    uintptr_t base;
+    const Elf32_Phdr* phdr;
+    int phnum;
+};
 
 __private_extern__
 void dyld_register_image_state_change_handler(
@@ -30,6 +57,198 @@ void dyld_register_image_state_change_handler(
         _objc_fatal("dyld handler for event %d is already set.",state);
     }
     dyld_handlers[state]=handler;
+    dyld_handler_batch[state]=batch;
+}
+
+static const char* const dyld_section_names[DYLD_SECT_COUNT]={
+    "__objc_imageinfo",
+    "__objc_classlist",
+    "__objc_nlclslist",
+    "__objc_catlist",
+    "__objc_nlcatlist",
+    "__objc_protolist",
+    "__objc_protorefs",
+    "__objc_classrefs",
+    "__objc_superrefs",
+    "__objc_selrefs",
+    "__objc_msgrefs",
+};
+
+/* Section headers are not mapped at runtime, so sections are found
+ *  through the linker-generated __start_<sect>/__stop_<sect> symbols.
+ *  Instead of two dlsym() hash lookups per section (per query), the
+ *  dynamic symbol table is walked once and all bounds are collected.
+ */
+static void set_section_bound(
+    struct dyld_section* sections,
+    const char* symbol,
+    char* address,
+    char** stops)
+{
+    static const char start_tag[]="__start_";
+    static const char stop_tag[]="__stop_";
+    const char* sectname;
+    char** bound;
+    int i;
+
+    if (symbol[0]!='_' || symbol[1]!='_') {
+        return;
+    }
+    if (!strncmp(symbol,start_tag,sizeof(start_tag)-1)) {
+        sectname=symbol+sizeof(start_tag)-1;
+        bound=NULL;
+    } else if (!strncmp(symbol,stop_tag,sizeof(stop_tag)-1)) {
+        sectname=symbol+sizeof(stop_tag)-1;
+        bound=stops;
+    } else {
+        return;
+    }
+    for (i=DYLD_SECT_IMAGEINFO+1;i!=DYLD_SECT_COUNT;++i) {
+        if (!strcmp(sectname,dyld_section_names[i])) {
+            if (bound) {
+                bound[i]=address;
+            } else {
+                sections[i].start=address;
+            }
+            return;
+        }
+    }
+}
+
+/* Bionic leaves d_ptr values in the dynamic section as link-time
+ *  addresses, while glibc relocates them in place.
+ */
+static uintptr_t dynamic_address(const struct dyld_image* image,Elf32_Addr ptr) {
+    if (image->base && ptr<image->base) {
+        return image->base+ptr;
+    }
+    return ptr;
+}
+
+/* Whether address lies in one of the image's PT_LOAD segments.
+ * The end of a segment counts, since a __stop_ symbol may point there.
+ */
+static int image_contains(const struct dyld_image* image,const char* address) {
+    uintptr_t value=(uintptr_t)address;
+    int i;
+    for (i=0;i!=image->phnum;++i) {
+        const Elf32_Phdr* phdr=&image->phdr[i];
+        uintptr_t start;
+        if (phdr->p_type!=PT_LOAD) {
+            continue;
+        }
+        start=image->base+phdr->p_vaddr;
+        if (value>=start && value<=start+phdr->p_memsz) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void find_image_sections(
+    const struct dyld_image* image,
+    struct dyld_section* sections)
+{
+    char* stops[DYLD_SECT_COUNT]={0};
+    const Elf32_Sym* symtab=NULL;
+    const char* strtab=NULL;
+    const unsigned* hash=NULL;
+    const Elf32_Dyn* dynamic=NULL;
+    int i;
+
+    memset(sections,0,sizeof(struct dyld_section)*DYLD_SECT_COUNT);
+
+    for (i=0;i!=image->phnum;++i) {
+        if (image->phdr[i].p_type==PT_DYNAMIC) {
+            dynamic=(const Elf32_Dyn*)(image->base+image->phdr[i].p_vaddr);
+            break;
+        }
+    }
+    if (!dynamic) {
+        return;
+    }
+
+    for (;dynamic->d_tag!=DT_NULL;++dynamic) {
+        switch (dynamic->d_tag) {
+            case DT_SYMTAB:
+                symtab=(const Elf32_Sym*)
+                    dynamic_address(image,dynamic->d_un.d_ptr);
+                break;
+            case DT_STRTAB:
+                strtab=(const char*)
+                    dynamic_address(image,dynamic->d_un.d_ptr);
+                break;
+            case DT_HASH:
+                hash=(const unsigned*)
+                    dynamic_address(image,dynamic->d_un.d_ptr);
+                break;
+        }
+    }
+
+    if (symtab && strtab && hash) {
+        // nchain (hash[1]) is the number of dynamic symbols.
+        unsigned nsyms=hash[1];
+        unsigned s;
+        for (s=1;s<nsyms;++s) {
+            const Elf32_Sym* sym=symtab+s;
+            if (sym->st_shndx==SHN_UNDEF) {
+                continue;
+            }
+            set_section_bound(sections,
+                strtab+sym->st_name,
+                (char*)(image->base+sym->st_value),
+                stops);
+        }
+    } else {
+        // No hash table to size the symbol table; fall back to dlsym.
+        // Image is already loaded, so this only takes a reference.
+        // dlsym also searches the image's dependencies, so drop any 
+        // bound that lies outside this image.
+        void* handle=dlopen(image->name[0] ? image->name : NULL,RTLD_NOW);
+        if (!handle) {
+            return;
+        }
+        for (i=DYLD_SECT_IMAGEINFO+1;i!=DYLD_SECT_COUNT;++i) {
+            const char* sectname=dyld_section_names[i];
+            char symbol_name[sizeof("__start_")+strlen(sectname)];
+            strcpy(symbol_name,"__start_");
+            strcat(symbol_name,sectname);
+            sections[i].start=(char*)dlsym(handle,symbol_name);
+            strcpy(symbol_name,"__stop_");
+            strcat(symbol_name,sectname);
+            stops[i]=(char*)dlsym(handle,symbol_name);
+            if (!image_contains(image,sections[i].start) ||
+                !image_contains(image,stops[i]))
+            {
+                sections[i].start=NULL;
+                stops[i]=NULL;
+            }
+        }
+        dlclose(handle);
+    }
+
+    for (i=DYLD_SECT_IMAGEINFO+1;i!=DYLD_SECT_COUNT;++i) {
+        if (!sections[i].start || !stops[i] || stops[i]<sections[i].start) {
+            sections[i].start=NULL;
+            sections[i].size=0;
+        } else {
+            sections[i].size=stops[i]-sections[i].start;
+        }
+    }
+
+    // ELF images carry no __objc_imageinfo; fake one for images that
+    // have any Objective-C metadata.
+    if (sections[DYLD_SECT_CLASSLIST].start ||
+        sections[DYLD_SECT_PROTOLIST].start ||
+        sections[DYLD_SECT_CATLIST].start)
+    {
+        static objc_image_info image_info={
+            version: 0,
+            flags: 0
+        };
+        sections[DYLD_SECT_IMAGEINFO].start=(char*)&image_info;
+        sections[DYLD_SECT_IMAGEINFO].size=sizeof(image_info);
+    }
 }
 
 __private_extern__
@@ -39,40 +258,15 @@ char *getsectdatafromheader(
     const char *sectname,
     uint32_t *size)
 {
-    if (!strcmp(sectname,"__objc_imageinfo")) {
-        static objc_image_info image_info={
-            version: 0,
-            flags: 0
-        };
-        if (!dlsym(mhp->handle,"__start___objc_classlist") &&
-            !dlsym(mhp->handle,"__start___objc_protolist") &&
-            !dlsym(mhp->handle,"__start___objc_catlist"))
-        {
-            *size=0;
-            return NULL;
+    int i;
+    for (i=0;i!=DYLD_SECT_COUNT;++i) {
+        if (!strcmp(sectname,dyld_section_names[i])) {
+            *size=mhp->sections[i].size;
+            return mhp->sections[i].start;
         }
-        *size=sizeof(image_info);
-        return (char*)&image_info;
-    }
-    void* start;
-    void* stop;
-    {
-        static const char* const start_tag="__start_";
-        static const char* const stop_tag="__stop_";
-        char symbol_name[strlen(start_tag)+strlen(sectname)+1];
-        strcpy(symbol_name,start_tag);
-        strcpy(symbol_name+strlen(start_tag),sectname);
-        start=dlsym(mhp->handle,symbol_name);
-        strcpy(symbol_name,stop_tag);
-        strcpy(symbol_name+strlen(stop_tag),sectname);
-        stop=dlsym(mhp->handle,symbol_name);
-    }
-    if (!start || !stop) {
-        *size=0;
-        return NULL;
     }
-    *size=(int)stop-(int)start;
-    return start;
+    *size=0;
+    return NULL;
 }
 
 __private_extern__
@@ -92,45 +286,404 @@ const char* dyld_image_path_containing_address(const void* addr) {
     return "";
 }
 
+__private_extern__
+const char* dyld_image_name(const struct mach_header* mh) {
+    return ((const struct dyld_image*)mh->handle)->name;
+}
+
+__private_extern__
+const uint8_t* dyld_image_build_id(
+    const struct mach_header* mh,
+    uint32_t* length)
+{
+    const struct dyld_image* image=(const struct dyld_image*)mh->handle;
+    const Elf32_Phdr* phdr=image->phdr;
+    int i;
+
+    for (i=0;i!=image->phnum;++i) {
+        if (phdr[i].p_type!=PT_NOTE) {
+            continue;
+        }
+        const uint8_t* note=(const uint8_t*)(image->base+phdr[i].p_vaddr);
+        const uint8_t* end=note+phdr[i].p_memsz;
+        while (note+sizeof(Elf32_Nhdr)<=end) {
+            const Elf32_Nhdr* nhdr=(const Elf32_Nhdr*)note;
+            const uint8_t* name=note+sizeof(Elf32_Nhdr);
+            const uint8_t* desc=name+((nhdr->n_namesz+3)&~3);
+            if (nhdr->n_type==NT_GNU_BUILD_ID &&
+                nhdr->n_namesz==4 && !memcmp(name,"GNU",4) &&
+                desc+nhdr->n_descsz<=end)
+            {
+                *length=nhdr->n_descsz;
+                return desc;
+            }
+            note=desc+((nhdr->n_descsz+3)&~3);
+        }
+    }
+    *length=0;
+    return NULL;
+}
+
+__private_extern__
+int dyld_image_protection(
+    const struct mach_header* mh,
+    const void* addr,
+    uint32_t size)
+{
+    const struct dyld_image* image=(const struct dyld_image*)mh->handle;
+    const Elf32_Phdr* phdr=image->phdr;
+    uintptr_t start=(uintptr_t)addr;
+    uintptr_t end=start+size;
+    int protection=-1;
+    int i;
+
+    for (i=0;i!=image->phnum;++i) {
+        if (phdr[i].p_type!=PT_LOAD) {
+            continue;
+        }
+        uintptr_t low=image->base+phdr[i].p_vaddr;
+        uintptr_t high=low+phdr[i].p_memsz;
+        if (start>=low && end<=high) {
+            protection=0;
+            if (phdr[i].p_flags & PF_R) protection|=PROT_READ;
+            if (phdr[i].p_flags & PF_W) protection|=PROT_WRITE;
+            if (phdr[i].p_flags & PF_X) protection|=PROT_EXEC;
+            break;
+        }
+    }
+    if (protection==-1) {
+        return -1;
+    }
+    for (i=0;i!=image->phnum;++i) {
+        if (phdr[i].p_type!=PT_GNU_RELRO) {
+            continue;
+        }
+        uintptr_t low=image->base+phdr[i].p_vaddr;
+        uintptr_t high=low+phdr[i].p_memsz;
+        if (start>=low && end<=high) {
+            // The caller changes protection of whole pages. If RELRO
+            //  ends mid-page, its last page also holds writable data
+            //  and isn't protected by the loader: not RELRO for us.
+            uintptr_t page_mask=(uintptr_t)getpagesize()-1;
+            if ((start&~page_mask)<(low&~page_mask) ||
+                ((end+page_mask)&~page_mask)>(high&~page_mask))
+            {
+                return -1;
+            }
+            protection&=~PROT_WRITE;
+        } else if (start<high && end>low) {
+            // Straddles the RELRO boundary: pages differ in protection.
+            return -1;
+        }
+    }
+    return protection;
+}
+
+/* Images already handed to the runtime, keyed by program header
+ *  address. Open addressing; pruned to the images seen by the latest
+ *  scan whenever an image disappears. The base address and a copy of
+ *  the name tell a new image apart from a dlclose'd one that had the
+ *  same program header address.
+ */
+struct known_image {
+    const Elf32_Phdr* phdr;
+    uintptr_t base;
+    char* name;
+    unsigned pass;
+};
+
+static struct known_image* known_images=NULL;
+static unsigned known_count=0;
+static unsigned known_capacity=0;
+static unsigned known_pass=0;
+
+// Loader's add/remove counters from the last pass (glibc only).
+static unsigned long long last_adds=0;
+static unsigned long long last_subs=0;
+static int have_counters=0;
+
+// Loader's add counter as of the last scan (glibc only).
+static unsigned long long scanned_adds=0;
+static int have_scanned_adds=0;
+
+static unsigned known_slot(const Elf32_Phdr* phdr) {
+    unsigned slot=((uintptr_t)phdr>>4)*2654435761u;
+    unsigned mask=known_capacity-1;
+    for (slot&=mask;;slot=(slot+1)&mask) {
+        if (!known_images[slot].phdr || known_images[slot].phdr==phdr) {
+            return slot;
+        }
+    }
+}
+
+/* Moves the table to a new one of the given capacity. With prune set,
+ *  images not seen by the current pass are dropped.
+ */
+static void known_rehash(unsigned capacity,int prune) {
+    struct known_image* old_images=known_images;
+    unsigned old_capacity=known_capacity;
+    unsigned i;
+
+    known_images=(struct known_image*)calloc(capacity,sizeof(*known_images));
+    known_capacity=capacity;
+    known_count=0;
+    for (i=0;i!=old_capacity;++i) {
+        struct known_image* known=&old_images[i];
+        if (!known->phdr) {
+            continue;
+        }
+        if (prune && known->pass!=known_pass) {
+            free(known->name);
+            continue;
+        }
+        known_images[known_slot(known->phdr)]=*known;
+        ++known_count;
+    }
+    free(old_images);
+}
+
+/* Returns 1 if the image wasn't known before. An image the loader
+ *  reports as added since the last scan is new even if its program
+ *  header address is known.
+ */
+static int known_add(const struct dl_phdr_info* info,int added) {
+    const Elf32_Phdr* phdr=(const Elf32_Phdr*)info->dlpi_phdr;
+    const char* name=info->dlpi_name ? info->dlpi_name : "";
+    struct known_image* known;
+
+    if ((known_count+1)*4>=known_capacity*3) {
+        known_rehash(known_capacity ? known_capacity*2 : 64,0);
+    }
+    known=&known_images[known_slot(phdr)];
+    known->pass=known_pass;
+    if (known->phdr) {
+        if (!added && known->base==info->dlpi_addr &&
+            !strcmp(known->name,name))
+        {
+            return 0;
+        }
+        // dlclose, then a new load at the same address.
+        free(known->name);
+    } else {
+        ++known_count;
+    }
+    known->phdr=phdr;
+    known->base=info->dlpi_addr;
+    known->name=strdup(name);
+    return 1;
+}
+
+static void image_range(
+    const Elf32_Phdr* phdr,int phnum,
+    uintptr_t* start,uintptr_t* size)
+{
+    uintptr_t low=(uintptr_t)-1;
+    uintptr_t high=0;
+    int i;
+    for (i=0;i!=phnum;++i) {
+        if (phdr[i].p_type==PT_LOAD) {
+            if (phdr[i].p_vaddr<low) {
+                low=phdr[i].p_vaddr;
+            }
+            if (phdr[i].p_vaddr+phdr[i].p_memsz>high) {
+                high=phdr[i].p_vaddr+phdr[i].p_memsz;
+            }
+        }
+    }
+    *start=high>low ? low : 0;
+    *size=high>low ? high-low : 0;
+}
+
+/* Like dyld, batch handlers get all images in one call and the others
+ *  get one call per image. info[] is in bottom-up order.
+ */
 static
-void call_dyld_handlers_on(soinfo_t* so) {
-    struct image_t {
-        struct mach_header header;
-        struct segment_command segment;
-    };
-    
-    struct image_t* image=(struct image_t*)malloc(sizeof(struct image_t));
-    struct dyld_image_info image_info={&image->header};
+void call_dyld_handlers_on(const struct dyld_image_info* info,uint32_t count) {
     unsigned i;
+    uint32_t j;
+
+    for (i=0;i!=DYLD_IMAGE_STATE_COUNT;++i) {
+        if (!dyld_handlers[i]) {
+            continue;
+        }
+        if (dyld_handler_batch[i]) {
+            dyld_handlers[i]((enum dyld_image_states)i,count,info);
+        } else {
+            for (j=0;j!=count;++j) {
+                dyld_handlers[i]((enum dyld_image_states)i,1,&info[j]);
+            }
+        }
+    }
+}
+
+static struct dyld_image* new_image(const struct dl_phdr_info* info) {
+    const Elf32_Phdr* phdr=(const Elf32_Phdr*)info->dlpi_phdr;
+    struct dyld_image* image;
+    uintptr_t start;
+    uintptr_t data_size;
+
+    image=(struct dyld_image*)malloc(sizeof(struct dyld_image));
+    image->name=info->dlpi_name ? info->dlpi_name : "";
+    image->base=info->dlpi_addr;
+    image->phdr=phdr;
+    image->phnum=info->dlpi_phnum;
 
     image->header.magic=MH_MAGIC;
     image->header.filetype=MH_BUNDLE;
-    image->header.ncmds=1;
-    image->header.handle=so;
-    image->segment.cmd=LC_SEGMENT;
-    image->segment.cmdsize=sizeof(struct segment_command);
-    strcpy(image->segment.segname,SEG_DATA);
-    image->segment.vmaddr=(uint32_t)&image->header;
-    image->segment.fileoff=0;
-    image->segment.filesize=so->size;
-    image->segment.nsects=0;
-    
-    for (i=0;i!=DYLD_IMAGE_STATE_COUNT;++i) {
-        if (dyld_handlers[i]) {
-            dyld_handlers[i]((enum dyld_image_states)i,1,&image_info);
+    image->header.handle=image;
+    image->header.ncmds=2;
+    image->text.cmd=LC_SEGMENT;
+    image->text.cmdsize=sizeof(struct segment_command);
+    strcpy(image->text.segname,SEG_TEXT);
+    image->text.vmaddr=(uint32_t)&image->header;
+    image->text.fileoff=0;
+    image->text.filesize=sizeof(image->header);
+    image->text.nsects=0;
+    image_range(phdr,info->dlpi_phnum,&start,&data_size);
+    image->data.cmd=LC_SEGMENT;
+    image->data.cmdsize=sizeof(struct segment_command);
+    strcpy(image->data.segname,SEG_DATA);
+    image->data.vmaddr=(uint32_t)(image->base+start);
+    image->data.fileoff=(uint32_t)start;
+    image->data.filesize=(uint32_t)data_size;
+    image->data.nsects=0;
+    return image;
+}
+
+/* Every loaded image, copied by scan_image, and the loader's counters
+ *  read under the same lock. Which images are new is decided after
+ *  the iteration, once their number is known. Sections are located
+ *  after the iteration too: the loader lock is held during
+ *  dl_iterate_phdr callbacks, and the dlsym fallback may need it.
+ */
+struct dyld_scan {
+    struct dl_phdr_info* infos;
+    unsigned count;
+    unsigned capacity;
+    unsigned long long adds;
+    int have_adds;
+};
+
+static int scan_image(struct dl_phdr_info* info,size_t size,void* data) {
+    struct dyld_scan* scan=(struct dyld_scan*)data;
+
+#ifdef __GLIBC__
+    if (size>=offsetof(struct dl_phdr_info,dlpi_subs)+sizeof(info->dlpi_subs)) {
+        scan->adds=info->dlpi_adds;
+        scan->have_adds=1;
+    }
+#endif
+    if (scan->count==scan->capacity) {
+        scan->capacity=scan->capacity ? scan->capacity*2 : 64;
+        scan->infos=(struct dl_phdr_info*)
+            realloc(scan->infos,scan->capacity*sizeof(struct dl_phdr_info));
+    }
+    scan->infos[scan->count++]=*info;
+    return 0;
+}
+
+// Returns 1 if the image has any Objective-C metadata.
+static int has_objc_sections(const struct dyld_image* image) {
+    int i;
+    for (i=DYLD_SECT_IMAGEINFO;i!=DYLD_SECT_COUNT;++i) {
+        if (image->header.sections[i].start) {
+            return 1;
         }
     }
-    
-    // Leak is intentional - we protect from getting the same memory
-    // region twice. Objc compares addresses of headers, and hence
-    // will not load second library.
-    //free(image);
+    return 0;
+}
+
+// Reads the loader's generation counters, if it exports them.
+static int read_counters(struct dl_phdr_info* info,size_t size,void* data) {
+#ifdef __GLIBC__
+    if (size>=offsetof(struct dl_phdr_info,dlpi_subs)+sizeof(info->dlpi_subs)) {
+        last_adds=info->dlpi_adds;
+        last_subs=info->dlpi_subs;
+        have_counters=1;
+    }
+#endif
+    return 1;
+}
+
+// Without loader counters every call is treated as a change.
+static int images_changed(void) {
+    unsigned long long adds=last_adds;
+    unsigned long long subs=last_subs;
+    int had_counters=have_counters;
+    dl_iterate_phdr(&read_counters,NULL);
+    return !had_counters || adds!=last_adds || subs!=last_subs;
 }
 
+/* Reports images loaded since the previous call to the registered
+ *  handlers. Called once at launch and then after each dlopen; only
+ *  new images are processed. Not thread safe, callers serialize.
+ */
 extern void call_dyld_handlers() {
-    soinfo_t* i=get_first_so();
-    i=i->next; // skip libdl.so
-    for (;i;i=i->next) {
-        call_dyld_handlers_on(i);
+    static int launched=0;
+    struct dyld_scan scan={0};
+    struct dyld_image_info* info;
+    uint32_t count;
+    unsigned added;
+    unsigned i;
+
+    if (!images_changed() && launched) {
+        return;
+    }
+
+    dl_iterate_phdr(&scan_image,&scan);
+
+    // The loader appends to its list, so the images it added since
+    // the last scan are the last ones listed. That catches an image
+    // loaded where a dlclose'd one used to be, even with the same name.
+    // Without the counter known_add compares base address and name.
+    added=0;
+    if (scan.have_adds && have_scanned_adds) {
+        unsigned long long delta=scan.adds-scanned_adds;
+        added=delta<scan.count ? (unsigned)delta : scan.count;
+    }
+    scanned_adds=scan.adds;
+    have_scanned_adds=scan.have_adds;
+
+    ++known_pass;
+    count=0;
+    for (i=0;i!=scan.count;++i) {
+        if (known_add(&scan.infos[i],i>=scan.count-added)) {
+            scan.infos[count++]=scan.infos[i];
+        }
+    }
+    if (scan.count!=known_count) {
+        // Some images were unloaded; forget them.
+        known_rehash(known_capacity,1);
+    }
+
+    // Leak of headers is intentional - we protect from getting the same
+    // memory region twice. Objc compares addresses of headers, and hence
+    // will not load second library.
+    // dl_iterate_phdr lists an image before the libraries it loaded,
+    // so walk backwards to get dyld's bottom-up order.
+    info=(struct dyld_image_info*)
+        malloc((count ? count : 1)*sizeof(struct dyld_image_info));
+    i=count;
+    count=0;
+    while (i--) {
+        struct dyld_image* image=new_image(&scan.infos[i]);
+        find_image_sections(image,image->header.sections);
+        if (!has_objc_sections(image)) {
+            free(image);
+            continue;
+        }
+        info[count++].imageLoadAddress=&image->header;
+    }
+    free(scan.infos);
+
+    if (count) {
+        call_dyld_handlers_on(info,count);
+    }
+    free(info);
+
+    if (!launched) {
+        launched=1;
+        // All images present at launch are processed.
+        launch_cache_finish();
     }
 }
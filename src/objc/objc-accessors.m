@@ -65,11 +65,11 @@ id objc_getProperty(id self, SEL _cmd, ptrdiff_t offset, BOOL atomic) {
     // Atomic retain release world
     OSSpinLock *slotlock = &PropertyLocks[GOODHASH(slot)];
     OSSpinLockLock(slotlock);
-    id value = [*slot retain];
+    id value = objc_retain(*slot);
     OSSpinLockUnlock(slotlock);
     
     // for performance, we (safely) issue the autorelease OUTSIDE of the spinlock.
-    return [value autorelease];
+    return objc_autorelease(value);
 }
 
 enum { OBJC_PROPERTY_RETAIN = 0, OBJC_PROPERTY_COPY = 1, OBJC_PROPERTY_MUTABLECOPY = 2 };
@@ -84,7 +84,7 @@ void objc_setProperty(id self, SEL _cmd, ptrdiff_t offset, id newValue, BOOL ato
     if (shouldCopy) {
         newValue = (shouldCopy == OBJC_PROPERTY_MUTABLECOPY ? [newValue mutableCopyWithZone:NULL] : [newValue copyWithZone:NULL]);
     } else {
-        newValue = [newValue retain];
+        newValue = objc_retain(newValue);
     }
 
     if (!atomic) {
@@ -98,7 +98,7 @@ void objc_setProperty(id self, SEL _cmd, ptrdiff_t offset, id newValue, BOOL ato
         OSSpinLockUnlock(slotlock);        
     }
 
-    [oldValue release];
+    objc_release(oldValue);
 }
 
 
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2011 Dmitry Skiba
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/***********************************************************************
+* objc-autorelease.m
+* Autorelease pools.
+*
+* Each thread keeps a stack of autoreleased objects in a doubly-linked
+* list of fixed-size pages. Pushing a pool stores a POOL_SENTINEL and
+* returns its address as the pool token; popping releases everything
+* above the token, newest first, with one linear scan per page.
+* The hot page (the one being filled) is kept in the thread's
+* _objc_pthread_data. When a pop empties pages, one empty page is
+* kept as the hot page's child so that the next push doesn't have to
+* allocate again.
+**********************************************************************/
+
+#include "objc-private.h"
+
+#define POOL_SENTINEL nil
+#define POOL_PAGE_SIZE 4096
+
+typedef struct autorelease_page {
+    struct autorelease_page *parent;
+    struct autorelease_page *child;
+    id *next;  // first free slot
+    id objects[0];
+} autorelease_page;
+
+static inline id *pageBegin(autorelease_page *page)
+{
+    return page->objects;
+}
+
+static inline id *pageEnd(autorelease_page *page)
+{
+    return (id *)((char *)page + POOL_PAGE_SIZE);
+}
+
+
+/***********************************************************************
+* newPage
+* Allocates an empty page and links it after parent, if any.
+**********************************************************************/
+static autorelease_page *newPage(autorelease_page *parent)
+{
+    autorelease_page *page = _malloc_internal(POOL_PAGE_SIZE);
+    page->parent = parent;
+    page->child = NULL;
+    page->next = pageBegin(page);
+    if (parent) parent->child = page;
+    return page;
+}
+
+
+/***********************************************************************
+* freePagesAfter
+* Frees every page after page.
+**********************************************************************/
+static void freePagesAfter(autorelease_page *page)
+{
+    autorelease_page *kill = page->child;
+    page->child = NULL;
+    while (kill) {
+        autorelease_page *next = kill->child;
+        _free_internal(kill);
+        kill = next;
+    }
+}
+
+
+/***********************************************************************
+* addSlow
+* Adds obj to a new hot page. The cached empty child is used if there
+* is one.
+**********************************************************************/
+static id *addSlow(_objc_pthread_data *data, id obj)
+{
+    autorelease_page *page = data->autoreleasePage;
+    if (!page) {
+        page = newPage(NULL);
+    } else if (page->child) {
+        page = page->child;
+    } else {
+        page = newPage(page);
+    }
+    data->autoreleasePage = page;
+
+    *page->next = obj;
+    return page->next++;
+}
+
+
+/***********************************************************************
+* add
+* Adds obj to the hot page and returns its slot.
+**********************************************************************/
+static inline id *add(_objc_pthread_data *data, id obj)
+{
+    autorelease_page *page = data->autoreleasePage;
+    if (page  &&  page->next < pageEnd(page)) {
+        *page->next = obj;
+        return page->next++;
+    }
+    return addSlow(data, obj);
+}
+
+
+/***********************************************************************
+* releaseUntil
+* Releases objects from the hot page downwards until the slot `stop`
+* on stopPage is removed. Nested pool sentinels are removed too.
+* Releasing an object can autorelease others, so the hot page is
+* reread for every object; objects added meanwhile are above `stop`
+* and get released by the same loop.
+**********************************************************************/
+static void releaseUntil(_objc_pthread_data *data,
+                         autorelease_page *stopPage, id *stop)
+{
+    while (1) {
+        autorelease_page *page = data->autoreleasePage;
+        if (page == stopPage  &&  page->next <= stop) break;
+
+        if (page->next == pageBegin(page)) {
+            // Emptied; keep it as a cached child of its parent.
+            data->autoreleasePage = page->parent;
+            continue;
+        }
+
+        id obj = *--page->next;
+        if (obj != POOL_SENTINEL) objc_release(obj);
+    }
+}
+
+
+/***********************************************************************
+* objc_autoreleasePoolPush
+* Pushes a new pool and returns its token.
+**********************************************************************/
+void *objc_autoreleasePoolPush(void)
+{
+    return add(_objc_fetch_pthread_data(YES), POOL_SENTINEL);
+}
+
+
+/***********************************************************************
+* objc_autoreleasePoolPop
+* Releases every object autoreleased since token was pushed,
+* and pops any pools pushed since then.
+**********************************************************************/
+void objc_autoreleasePoolPop(void *token)
+{
+    _objc_pthread_data *data = _objc_fetch_pthread_data(NO);
+    id *stop = (id *)token;
+    autorelease_page *page;
+
+    // Find the page holding token. Usually it is the hot page.
+    page = data ? data->autoreleasePage : NULL;
+    while (page  &&  !(stop >= pageBegin(page)  &&  stop < page->next)) {
+        page = page->parent;
+    }
+    if (!page  ||  *stop != POOL_SENTINEL) {
+        _objc_fatal("objc_autoreleasePoolPop: invalid or already popped "
+                    "autorelease pool %p", token);
+    }
+
+    releaseUntil(data, page, stop);
+
+    // Keep at most one empty page around for the next push.
+    if (page->child) freePagesAfter(page->child);
+}
+
+
+/***********************************************************************
+* _objc_autoreleasePoolAdd
+* Adds obj to the innermost pool of the current thread.
+* Without a pool obj is leaked, with a complaint.
+**********************************************************************/
+__private_extern__ id _objc_autoreleasePoolAdd(id obj)
+{
+    _objc_pthread_data *data = _objc_fetch_pthread_data(YES);
+    autorelease_page *page = data->autoreleasePage;
+
+    // Every pool starts with a sentinel, so an empty stack has no pool.
+    if (!page  ||  (page->next == pageBegin(page)  &&  !page->parent)) {
+        _objc_inform("object %p of class %s autoreleased with no pool "
+                     "in place - just leaking", obj, object_getClassName(obj));
+        return obj;
+    }
+
+    add(data, obj);
+    return obj;
+}
+
+
+/***********************************************************************
+* _destroyAutoreleasePages
+* Pops pools a thread left open when it exits and frees its pages.
+* The caller must keep data reachable through _objc_fetch_pthread_data
+* while this runs; releasing objects may run arbitrary code.
+**********************************************************************/
+__private_extern__ void _destroyAutoreleasePages(_objc_pthread_data *data)
+{
+    autorelease_page *base = data->autoreleasePage;
+    if (!base) return;
+
+    while (base->parent) base = base->parent;
+    releaseUntil(data, base, pageBegin(base));
+
+    freePagesAfter(base);
+    _free_internal(base);
+    data->autoreleasePage = NULL;
+}
@@ -80,20 +80,22 @@
  * _class_printDuplicateCacheEntries
  * _class_printMethodCacheStatistics
  *
+ * forward:: entries (negative cache entries) are never freed. There is 
+ * exactly one forward:: entry per selector, shared by every cache that 
+ * records that selector as unimplemented (see _cache_forwardEntry). 
+ * Flushing or expanding a cache therefore only drops bucket pointers.
+ *
  * _class_lookupMethodAndLoadCache is a special case. It may read a 
- * method triplet out of one cache and store it in another cache. This 
- * is unsafe if the method triplet is a forward:: entry, because the 
- * triplet itself could be freed unless _class_lookupMethodAndLoadCache 
- * were PC-checked or used a lock. Additionally, storing the method 
- * triplet in both caches would result in double-freeing if both caches 
- * were flushed or expanded. The solution is for _cache_getMethod to 
- * ignore all entries whose implementation is _objc_msgForward_internal, 
- * so _class_lookupMethodAndLoadCache cannot look at a forward:: entry
- * unsafely or place it in multiple caches.
+ * method triplet out of one cache and store it in another cache. 
+ * _cache_getMethod ignores all entries whose implementation is 
+ * _objc_msgForward_internal, so _class_lookupMethodAndLoadCache 
+ * treats a forward:: entry in a superclass cache as a miss and 
+ * re-resolves the selector for the subclass instead.
  ***********************************************************************/
 
 #include "objc-private.h"
 #include "hashtable2.h"
+#include <objc/message.h>
 
 #undef TARGET_OS_WIN32
 #define TARGET_OS_WIN32 1
@@ -104,11 +106,13 @@ typedef struct {
     IMP imp;  // same layout as struct old_method
 } cache_entry;
 
-#ifndef __LP64__
-#define CACHE_HASH(sel, mask) (((uintptr_t)(sel)>>2) & (mask))
-#else
-#define CACHE_HASH(sel, mask) (((unsigned int)((uintptr_t)(sel)>>3)) & (mask))
-#endif
+/* Selectors are string addresses. Names registered at runtime are 
+ * malloc'd and 8-byte aligned, so bits 0-2 carry nothing for them; 
+ * skipping bit 2 as well spreads both those and the packed names in 
+ * __objc_methname better than sel >> 2 (see bench/cache_hash.c), and 
+ * still costs a single shifted and in the messenger.
+ * CACHE_HASH must match CacheLookup in objc-msg-arm.S. */
+#define CACHE_HASH(sel, mask) (((uintptr_t)(sel)>>3) & (mask))
 
 struct objc_cache {
     uintptr_t mask;            /* total = mask + 1 */
@@ -140,7 +144,9 @@ enum {
 #define TABLE_SIZE(count)  ((count - 1) * sizeof(cache_entry *))
 
 
-#if !TARGET_OS_WIN32
+// The cache allocator needs only mmap, so it is used 
+// on Linux even though the mach-only paths in this file are not.
+#if !TARGET_OS_WIN32  ||  defined(__linux__)
 #   define CACHE_ALLOCATOR
 #endif
 
@@ -235,6 +241,9 @@ static Cache _cache_create(Class cls);
 static Cache _cache_expand(Class cls);
 static void _cache_flush(Class cls);
 
+static void _cache_tallyProbes(Cache cache);
+static void _cache_printProbeHistograms(void);
+
 static int _collecting_in_critical(void);
 static void _garbage_make_room(void);
 static void _cache_collect_free(void *data, size_t size, BOOL tryCollect);
@@ -243,6 +252,7 @@ static void _cache_collect_free(void *data, size_t size, BOOL tryCollect);
 static BOOL cache_allocator_is_block(void *block);
 static void *cache_allocator_calloc(size_t size);
 static void cache_allocator_free(void *block);
+static void cache_allocator_print_stats(void);
 #endif
 
 /***********************************************************************
@@ -253,6 +263,14 @@ static size_t cache_allocations;
 static size_t cache_collections;
 static size_t cache_allocator_regions;
 
+/* Probe length histograms. Index is the number of buckets examined. */
+enum {
+    CACHE_HISTOGRAM_SIZE    = 512
+};
+
+static unsigned int CacheHitHistogram [CACHE_HISTOGRAM_SIZE];
+static unsigned int CacheMissHistogram [CACHE_HISTOGRAM_SIZE];
+
 static size_t log2u(size_t x)
 {
     unsigned int log;
@@ -327,8 +345,8 @@ static Cache _cache_malloc(uintptr_t slotCount)
 * _cache_free_block.
 *
 * Called from _cache_free() and _cache_collect_free().
-* block may be a cache or a forward:: entry.
-* If block is a cache, forward:: entries it points to will NOT be freed.
+* block is a cache. forward:: entries it points to are shared and 
+* are never freed.
 * Cache locks: cacheUpdateLock must be held by the caller.
 **********************************************************************/
 static void _cache_free_block(void *block)
@@ -363,22 +381,13 @@ static void _cache_free_block(void *block)
 * _cache_free.
 *
 * Called from _objc_remove_classes_in_image().
-* forward:: entries in the cache ARE freed.
+* forward:: entries in the cache are shared and are NOT freed.
 * Cache locks: cacheUpdateLock must NOT be held by the caller.
 **********************************************************************/
 __private_extern__ void _cache_free(Cache cache)
 {
-    unsigned int i;
-
     mutex_lock(&cacheUpdateLock);
 
-    for (i = 0; i < cache->mask + 1; i++) {
-        cache_entry *entry = (cache_entry *)cache->buckets[i];
-        if (entry  &&  entry->imp == &_objc_msgForward_internal) {
-            _cache_free_block(entry);
-        }
-    }
-    
     _cache_free_block(cache);
 
     mutex_unlock(&cacheUpdateLock);
@@ -445,27 +454,15 @@ static Cache _cache_expand(Class cls)
             // Reuse the current cache storage this time. Do grow next time.
             _class_setGrowCache(cls, YES);
 
+            if (PrintCaches) _cache_tallyProbes(old_cache);
+
             // Clear the valid-entry counter
             old_cache->occupied = 0;
 
             // Invalidate all the cache entries
             for (index = 0; index < old_cache->mask + 1; index += 1)
             {
-                // Remember what this entry was, so we can possibly
-                // deallocate it after the bucket has been invalidated
-                cache_entry *oldEntry = (cache_entry *)old_cache->buckets[index];
-                
-                // Skip invalid entry
-                if (!oldEntry)
-                    continue;
-
-                // Invalidate this entry
                 old_cache->buckets[index] = NULL;
-
-                // Deallocate "forward::" entry
-                if (oldEntry->imp == &_objc_msgForward_internal) {
-                    _cache_collect_free (oldEntry, sizeof(cache_entry), NO);
-                }
             }
 
             // Return the same old cache, freshly emptied
@@ -473,6 +470,8 @@ static Cache _cache_expand(Class cls)
         }
     }
 
+    if (PrintCaches) _cache_tallyProbes(old_cache);
+
     // Double the cache size
     slotCount = (old_cache->mask + 1) << 1;
 
@@ -490,14 +489,6 @@ static Cache _cache_expand(Class cls)
     }
 #endif
 
-    // Deallocate "forward::" entries from the old cache
-    for (index = 0; index < old_cache->mask + 1; index++) {
-        cache_entry *entry = (cache_entry *)old_cache->buckets[index];
-        if (entry && entry->imp == &_objc_msgForward_internal) {
-            _cache_collect_free (entry, sizeof(cache_entry), NO);
-        }
-    }
-
     // Install new cache
     _class_setCache(cls, new_cache);
 
@@ -605,6 +596,41 @@ __private_extern__ BOOL _cache_fill(Class cls, Method smt, SEL sel)
 }
 
 
+// Shared forward:: entries, keyed by selector
+static NXMapTable *forward_entries = NULL;
+
+/***********************************************************************
+* _cache_forwardEntry
+* Returns the shared forward:: entry for the given selector, creating 
+* it if necessary. forward:: entries live as long as the selector does 
+* and are never freed, so caches can drop them without any cleanup.
+* Cache locks: cacheUpdateLock must be held by the caller.
+**********************************************************************/
+static cache_entry *_cache_forwardEntry(SEL sel)
+{
+    cache_entry *smt;
+
+    mutex_assert_locked(&cacheUpdateLock);
+
+    if (!forward_entries) {
+        forward_entries = 
+            NXCreateMapTableFromZone(NXPtrValueMapPrototype, 32, 
+                                     _objc_internal_zone());
+    }
+
+    smt = (cache_entry *)NXMapGet(forward_entries, sel);
+    if (!smt) {
+        smt = _malloc_internal(sizeof(cache_entry));
+        smt->name = sel;
+        smt->unused = NULL;
+        smt->imp = &_objc_msgForward_internal;
+        NXMapInsert(forward_entries, sel, smt);
+    }
+
+    return smt;
+}
+
+
 /***********************************************************************
 * _cache_addForwardEntry
 * Add a forward:: entry  for the given selector to cls's method cache.
@@ -615,14 +641,13 @@ __private_extern__ BOOL _cache_fill(Class cls, Method smt, SEL sel)
 __private_extern__ void _cache_addForwardEntry(Class cls, SEL sel)
 {
     cache_entry *smt;
-  
-    smt = _malloc_internal(sizeof(cache_entry));
-    smt->name = sel;
-    smt->imp = &_objc_msgForward_internal;
-    if (! _cache_fill(cls, (Method)smt, sel)) {  // fixme hack
-        // Entry not added to cache. Don't leak the method struct.
-        _free_internal(smt);
-    }
+
+    mutex_lock(&cacheUpdateLock);
+    smt = _cache_forwardEntry(sel);
+    mutex_unlock(&cacheUpdateLock);
+
+    // The entry is shared, so there is nothing to undo if this fails.
+    _cache_fill(cls, (Method)smt, sel);
 }
 
 
@@ -656,19 +681,13 @@ static void _cache_flush(Class cls)
     }
 #endif
 
-    // Traverse the cache
+    if (PrintCaches) _cache_tallyProbes(cache);
+
+    // Invalidate all the cache entries.
+    // forward:: entries are shared, so nothing needs to be freed.
     for (index = 0; index <= cache->mask; index += 1)
     {
-        // Remember what this entry was, so we can possibly
-        // deallocate it after the bucket has been invalidated
-        cache_entry *oldEntry = (cache_entry *)cache->buckets[index];
-
-        // Invalidate this entry
         cache->buckets[index] = NULL;
-
-        // Deallocate "forward::" entry
-        if (oldEntry && oldEntry->imp == &_objc_msgForward_internal)
-            _cache_collect_free (oldEntry, sizeof(cache_entry), NO);
     }
 
     // Clear the valid-entry counter
@@ -676,6 +695,65 @@ static void _cache_flush(Class cls)
 }
 
 
+/***********************************************************************
+* objc_methodGeneration
+* Incremented whenever a method cache is flushed or a method's IMP 
+* changes, so IMPs cached outside the runtime (see objc_msgLookup) 
+* can be revalidated with a single compare.
+* Every bump must come after the change it publishes: readers sample 
+* the generation before they look up an IMP.
+**********************************************************************/
+volatile uint32_t objc_methodGeneration = 0;
+
+__private_extern__ void _cache_bumpMethodGeneration(void)
+{
+    OSAtomicIncrement32Barrier((volatile int32_t *)&objc_methodGeneration);
+}
+
+
+/***********************************************************************
+* _cache_fillICSlot
+* Slow path of objc_msgSend_ic. Looks up slot->sel for self's class and 
+* returns the IMP to call. An empty or stale slot is refilled. A current 
+* slot for some other class is left alone, so a polymorphic call site 
+* keeps its first class and uses the method cache for the rest.
+* The slot is written so that a concurrent objc_msgSend_ic never pairs 
+* a class with another class's IMP: cls is cleared first, written after 
+* imp, and re-checked by the reader after it loads imp.
+* Cache locks: cacheUpdateLock must not be held by the caller.
+**********************************************************************/
+__private_extern__ IMP _cache_fillICSlot(id self, objc_ic_slot *slot)
+{
+    // Read the generation before the lookup. A flush that races with 
+    // the lookup then leaves the slot stale rather than wrong.
+    uint32_t generation = objc_methodGeneration;
+    Class cls = _object_getIsa(self);
+    IMP imp;
+
+    mutex_assert_unlocked(&cacheUpdateLock);
+
+    // A stale slot skipped the method cache, so look there first.
+    imp = lookUpMethod(cls, slot->sel, YES/*initialize*/, YES/*cache*/);
+
+    // Never cache before +initialize is done
+    if (!_class_isInitialized(cls)) return imp;
+
+    mutex_lock(&cacheUpdateLock);
+    if (slot->cls == Nil  ||  slot->generation != objc_methodGeneration) {
+        slot->cls = Nil;
+        OSMemoryBarrier();
+        slot->imp = imp;
+        OSMemoryBarrier();
+        slot->cls = cls;
+        OSMemoryBarrier();
+        slot->generation = generation;
+    }
+    mutex_unlock(&cacheUpdateLock);
+
+    return imp;
+}
+
+
 /***********************************************************************
 * flush_cache.  Flushes the instance method cache for class cls only.
 * Use flush_caches() if cls might have in-use subclasses.
@@ -685,11 +763,109 @@ __private_extern__ void flush_cache(Class cls)
     if (cls) {
         mutex_lock(&cacheUpdateLock);
         _cache_flush(cls);
+        // Bump only after the flush. A lookup that reads the new 
+        // generation must not be able to find an entry the flush removes.
+        _cache_bumpMethodGeneration();
         mutex_unlock(&cacheUpdateLock);
     }
 }
 
 
+/***********************************************************************
+* _cache_tallyProbes.
+* Adds the probe length of a hit on every entry, and of a miss starting 
+* at every bucket, to the probe histograms. Called for caches about to 
+* be flushed or discarded, when they are at their fullest.
+* Under OBJC_INSTRUMENTED, the cache's own probe counters are updated too.
+* Cache locks: cacheUpdateLock must be held by the caller.
+**********************************************************************/
+static void _cache_tallyProbes(Cache cache)
+{
+    cache_entry **buckets = (cache_entry **)cache->buckets;
+    uintptr_t mask = cache->mask;
+    uintptr_t index;
+#ifdef OBJC_INSTRUMENTED
+    CacheInstrumentation *cacheData = CACHE_INSTRUMENTATION(cache);
+#endif
+
+    mutex_assert_locked(&cacheUpdateLock);
+
+    if (_cache_isEmpty(cache)) return;
+
+    for (index = 0; index <= mask; index++) {
+        uintptr_t hitProbes = 0;
+        uintptr_t missProbes = 1;
+        uintptr_t index2 = index;
+
+        // A miss examines every bucket up to and including the next hole
+        while (buckets[index2]  &&  missProbes <= mask) {
+            index2 = (index2 + 1) & mask;
+            missProbes++;
+        }
+        if (missProbes >= CACHE_HISTOGRAM_SIZE) {
+            CacheMissHistogram[CACHE_HISTOGRAM_SIZE - 1]++;
+        } else {
+            CacheMissHistogram[missProbes]++;
+        }
+
+        // A hit examines every bucket from the selector's home to its entry
+        if (buckets[index]) {
+            hitProbes = ((index - CACHE_HASH(buckets[index]->name, mask)) & mask) + 1;
+            if (hitProbes >= CACHE_HISTOGRAM_SIZE) {
+                CacheHitHistogram[CACHE_HISTOGRAM_SIZE - 1]++;
+            } else {
+                CacheHitHistogram[hitProbes]++;
+            }
+        }
+
+#ifdef OBJC_INSTRUMENTED
+        cacheData->missCount += 1;
+        cacheData->missProbes += missProbes;
+        if (missProbes > cacheData->maxMissProbes)
+            cacheData->maxMissProbes = missProbes;
+        if (hitProbes) {
+            cacheData->hitCount += 1;
+            cacheData->hitProbes += hitProbes;
+            if (hitProbes > cacheData->maxHitProbes)
+                cacheData->maxHitProbes = hitProbes;
+        }
+#endif
+    }
+}
+
+
+/***********************************************************************
+* _cache_printProbeHistograms.
+* Logs the probe length histograms for OBJC_PRINT_CACHE_SETUP.
+**********************************************************************/
+static void _cache_printProbeHistograms(void)
+{
+    unsigned int index;
+    size_t hits = 0, hitProbes = 0;
+    size_t misses = 0, missProbes = 0;
+
+    for (index = 0; index < CACHE_HISTOGRAM_SIZE; index++) {
+        hits += CacheHitHistogram[index];
+        hitProbes += (size_t)CacheHitHistogram[index] * index;
+        misses += CacheMissHistogram[index];
+        missProbes += (size_t)CacheMissHistogram[index] * index;
+    }
+    if (!hits  &&  !misses) return;
+
+    _objc_inform("CACHES: probes: %zu.%02zu avg per hit, %zu.%02zu avg per miss", 
+                 hits ? hitProbes / hits : 0, 
+                 hits ? hitProbes * 100 / hits % 100 : 0, 
+                 misses ? missProbes / misses : 0, 
+                 misses ? missProbes * 100 / misses % 100 : 0);
+    for (index = 0; index < CACHE_HISTOGRAM_SIZE; index++) {
+        if (!CacheHitHistogram[index]  &&  !CacheMissHistogram[index]) continue;
+        _objc_inform("CACHES: %3u%s probes: %8u hits, %8u misses", index, 
+                     index == CACHE_HISTOGRAM_SIZE - 1 ? "+" : " ", 
+                     CacheHitHistogram[index], CacheMissHistogram[index]);
+    }
+}
+
+
 /***********************************************************************
 * cache collection.
 **********************************************************************/
@@ -755,6 +931,9 @@ static uintptr_t _get_pc_for_thread(thread_t thread)
 * function. Collection of cache garbage is not allowed when a cache-
 * reading function is in progress because it might still be using 
 * the garbage memory.
+* This port has no way to sample other threads' pcs (the mach thread 
+* calls below are unavailable), so it always answers TRUE: replaced 
+* caches are never collected, only freed by _cache_free at unload.
 **********************************************************************/
 OBJC_EXPORT uintptr_t objc_entryPoints[];
 OBJC_EXPORT uintptr_t objc_exitPoints[];
@@ -960,6 +1139,12 @@ static void _cache_collect_free(void *data, size_t size, BOOL tryCollect)
         }
 
         _objc_inform("CACHES:      total: %4zu caches, %6zu / %6zu / %6zu bytes ideal/malloc/local, %6zu / %6zu bytes wasted malloc/local", total, ideal_total, malloc_total, local_total, malloc_total-ideal_total, local_total-ideal_total);
+
+#if defined(CACHE_ALLOCATOR)
+        cache_allocator_print_stats();
+#endif
+
+        _cache_printProbeHistograms();
     }
 }
 
@@ -976,46 +1161,59 @@ static void _cache_collect_free(void *data, size_t size, BOOL tryCollect)
 * with 128 or more slots, which adds up to tens of KB for an AppKit process.
 * To save memory, the custom cache allocator below is used.
 * 
-* The cache allocator uses 128 KB allocation regions. Few processes will 
-* require a second region. Within a region, allocation is address-ordered 
-* first fit.
+* The cache allocator uses 128 KB allocation regions obtained with mmap. 
+* Few processes will require a second region. Within a region, allocation 
+* is address-ordered first fit over an allocation bitmap with one bit 
+* per quantum (252 quanta, 32 bytes of bitmap per 128 KB region).
 * 
 * The cache allocator uses a quantum of 520.
 * Cache block ideal sizes: 520, 1032, 2056, 4104
 * Cache allocator sizes:   520, 1040, 2080, 4160
 *
 * Because all blocks are known to be genuine method caches, the ordinary 
-* cache->mask and cache->occupied fields are used as block headers. 
-* No out-of-band headers are maintained. The number of blocks will 
-* almost always be fewer than 200, so for simplicity there is no free 
-* list or other optimization.
+* cache->mask field is used as the block header: it determines the 
+* block size when the block is freed. Free space lives only in the 
+* bitmap; no in-band headers are maintained for free blocks.
 * 
-* Block in use: mask != 0, occupied != -1 (mask indicates block size)
-* Block free:   mask != 0, occupied == -1 (mask is precisely block size)
+* Regions are never returned to the system. Replaced caches go to the 
+* garbage list, which this port never empties (see 
+* _collecting_in_critical), so a region is rarely empty anyway.
 * 
 * No cache allocator functions take any locks. Instead, the caller 
 * must hold the cacheUpdateLock.
-* 
-* fixme with 128 KB regions and 520 B min block size, an allocation
-* bitmap would be only 32 bytes - better than free list?
 **********************************************************************/
 
-typedef struct cache_allocator_block {
-    uintptr_t size;
-    uintptr_t state;
-    struct cache_allocator_block *nextFree;
-} cache_allocator_block;
+#define CACHE_BITMAP_BITS (8 * sizeof(uint32_t))
 
 typedef struct cache_allocator_region {
-    cache_allocator_block *start;
-    cache_allocator_block *end;    // first non-block address
-    cache_allocator_block *freeList;
+    uintptr_t start;
+    uintptr_t end;      // first non-block address
+    size_t quanta;      // number of CACHE_QUANTUM units in the region
+    size_t used;        // number of allocated quanta
     struct cache_allocator_region *next;
+    uint32_t bitmap[0]; // one bit per quantum, set if allocated
 } cache_allocator_region;
 
 static cache_allocator_region *cacheRegion = NULL;
 
 
+static inline BOOL cache_bitmap_test(cache_allocator_region *rgn, size_t q)
+{
+    return (rgn->bitmap[q / CACHE_BITMAP_BITS] >> (q % CACHE_BITMAP_BITS)) & 1;
+}
+
+static void cache_bitmap_set(cache_allocator_region *rgn, 
+                             size_t q, size_t count, BOOL value)
+{
+    size_t end = q + count;
+    for ( ; q < end; q++) {
+        uint32_t bit = (uint32_t)1 << (q % CACHE_BITMAP_BITS);
+        if (value) rgn->bitmap[q / CACHE_BITMAP_BITS] |= bit;
+        else rgn->bitmap[q / CACHE_BITMAP_BITS] &= ~bit;
+    }
+}
+
+
 /***********************************************************************
 * cache_allocator_add_region
 * Allocates and returns a new region that can hold at least size 
@@ -1028,28 +1226,30 @@ static cache_allocator_region *cacheRegion = NULL;
 **********************************************************************/
 static cache_allocator_region *cache_allocator_add_region(size_t size)
 {
-    vm_address_t addr;
-    cache_allocator_block *b;
+    void *addr;
+    size_t quanta;
     cache_allocator_region **rgnP;
-    cache_allocator_region *newRegion = 
-        _calloc_internal(1, sizeof(cache_allocator_region));
+    cache_allocator_region *newRegion;
 
     // Round size up to quantum boundary, and apply the minimum size.
     size += CACHE_QUANTUM - (size % CACHE_QUANTUM);
     if (size < CACHE_REGION_SIZE) size = CACHE_REGION_SIZE;
+    quanta = size / CACHE_QUANTUM;
 
     // Allocate the region
-    addr = 0;
-    vm_allocate(mach_task_self(), &addr, size, 1);
-    newRegion->start = (cache_allocator_block *)addr;
-    newRegion->end = (cache_allocator_block *)(addr + size);
-
-    // Mark the first block: free and covers the entire region
-    b = newRegion->start;
-    b->size = size;
-    b->state = (uintptr_t)-1;
-    b->nextFree = NULL;
-    newRegion->freeList = b;
+    addr = mmap(NULL, size, PROT_READ|PROT_WRITE, 
+                MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        _objc_fatal("could not allocate %zu bytes for method caches "
+                    "(errno %d)", size, errno);
+    }
+
+    // Region bookkeeping and bitmap. All quanta start out free.
+    newRegion = _calloc_internal(1, sizeof(cache_allocator_region) + 
+        (quanta + CACHE_BITMAP_BITS - 1) / CACHE_BITMAP_BITS * sizeof(uint32_t));
+    newRegion->start = (uintptr_t)addr;
+    newRegion->end = (uintptr_t)addr + size;
+    newRegion->quanta = quanta;
 
     // Add to end of the linked list of regions.
     // Other regions should be re-used before this one is touched.
@@ -1066,67 +1266,56 @@ static cache_allocator_region *cache_allocator_add_region(size_t size)
 }
 
 
-/***********************************************************************
-* cache_allocator_coalesce
-* Attempts to coalesce a free block with the single free block following 
-* it in the free list, if any.
-**********************************************************************/
-static void cache_allocator_coalesce(cache_allocator_block *block)
-{
-    if (block->size + (uintptr_t)block == (uintptr_t)block->nextFree) {
-        block->size += block->nextFree->size;
-        block->nextFree = block->nextFree->nextFree;
-    }
-}
-
-
 /***********************************************************************
 * cache_region_calloc
 * Attempt to allocate a size-byte block in the given region. 
-* Allocation is first-fit. The free list is already fully coalesced.
+* Allocation is first-fit over the region's bitmap. 
 * Returns NULL if there is not enough room in the region for the block.
 **********************************************************************/
 static void *cache_region_calloc(cache_allocator_region *rgn, size_t size)
 {
-    cache_allocator_block **blockP;
     uintptr_t mask;
+    size_t count;
+    size_t run;
+    size_t q;
 
     // Save mask for allocated block, then round size 
     // up to CACHE_QUANTUM boundary
     mask = cache_allocator_mask_for_size(size);
     size = cache_allocator_size_for_mask(mask);
+    count = size / CACHE_QUANTUM;
 
-    // Search the free list for a sufficiently large free block.
+    if (rgn->quanta - rgn->used < count) return NULL;
 
-    for (blockP = &rgn->freeList; 
-         *blockP != NULL; 
-         blockP = &(**blockP).nextFree) 
-    {
-        cache_allocator_block *block = *blockP;
-        if (block->size < size) continue;  // not big enough
-
-        // block is now big enough. Allocate from it.
-
-        // Slice off unneeded fragment of block, if any, 
-        // and reconnect the free list around block.
-        if (block->size - size >= CACHE_QUANTUM) {
-            cache_allocator_block *leftover = 
-                (cache_allocator_block *)(size + (uintptr_t)block);
-            leftover->size = block->size - size;
-            leftover->state = (uintptr_t)-1;
-            leftover->nextFree = block->nextFree;
-            *blockP = leftover;
-        } else {
-            *blockP = block->nextFree;
+    // Search the bitmap for a run of count free quanta.
+    run = 0;
+    for (q = 0; q < rgn->quanta; q++) {
+        if (q % CACHE_BITMAP_BITS == 0  &&  
+            rgn->bitmap[q / CACHE_BITMAP_BITS] == ~(uint32_t)0) 
+        {
+            // Whole word allocated - skip it.
+            run = 0;
+            q += CACHE_BITMAP_BITS - 1;
+            continue;
         }
-            
-        // block is now exactly the right size.
+        if (cache_bitmap_test(rgn, q)) {
+            run = 0;
+            continue;
+        }
+        if (++run == count) {
+            Cache block;
+            q = q + 1 - count;
+            block = (Cache)(rgn->start + q * CACHE_QUANTUM);
+
+            cache_bitmap_set(rgn, q, count, YES);
+            rgn->used += count;
 
-        bzero(block, size);
-        block->size = mask;  // Cache->mask
-        block->state = 0;    // Cache->occupied
+            bzero(block, size);
+            block->mask = mask;
+            block->occupied = 0;
 
-        return block;
+            return block;
+        }
     }
 
     // No room in this region.
@@ -1164,11 +1353,12 @@ static void *cache_allocator_calloc(size_t size)
 * cache_allocator_region_for_block
 * Returns the cache allocator region that ptr points into, or NULL.
 **********************************************************************/
-static cache_allocator_region *cache_allocator_region_for_block(cache_allocator_block *block) 
+static cache_allocator_region *cache_allocator_region_for_block(void *block) 
 {
     cache_allocator_region *rgn;
     for (rgn = cacheRegion; rgn != NULL; rgn = rgn->next) {
-        if (block >= rgn->start  &&  block < rgn->end) return rgn;
+        if ((uintptr_t)block >= rgn->start  &&  
+            (uintptr_t)block < rgn->end) return rgn;
     }
     return NULL;
 }
@@ -1184,57 +1374,90 @@ static cache_allocator_region *cache_allocator_region_for_block(cache_allocator_
 static BOOL cache_allocator_is_block(void *ptr)
 {
     mutex_assert_locked(&cacheUpdateLock);
-    return (cache_allocator_region_for_block((cache_allocator_block *)ptr) != NULL);
+    return (cache_allocator_region_for_block(ptr) != NULL);
 }
 
 /***********************************************************************
 * cache_allocator_free
-* Frees a block allocated by the cache allocator.
+* Frees a block allocated by the cache allocator. The space can be 
+* reused by later caches; the region itself is kept.
+* Note: replaced caches go to the garbage list, which is never emptied 
+* on this port (see _collecting_in_critical). Blocks therefore only get 
+* here from _cache_free at image unload.
 * Cache locks: cacheUpdateLock must be held by the caller.
 **********************************************************************/
 static void cache_allocator_free(void *ptr)
 {
-    cache_allocator_block *dead = (cache_allocator_block *)ptr;
-    cache_allocator_block *cur;
+    Cache dead = (Cache)ptr;
     cache_allocator_region *rgn;
+    size_t q, count;
 
     mutex_assert_locked(&cacheUpdateLock);
 
-    if (! (rgn = cache_allocator_region_for_block(ptr))) {
+    if (! (rgn = cache_allocator_region_for_block(ptr))  ||  
+        ((uintptr_t)ptr - rgn->start) % CACHE_QUANTUM != 0) 
+    {
         // free of non-pointer
         _objc_inform("cache_allocator_free of non-pointer %p", ptr);
         return;
     }    
 
-    dead->size = cache_allocator_size_for_mask(dead->size);
-    dead->state = (uintptr_t)-1;
-
-    if (!rgn->freeList  ||  rgn->freeList > dead) {
-        // dead block belongs at front of free list
-        dead->nextFree = rgn->freeList;
-        rgn->freeList = dead;
-        cache_allocator_coalesce(dead);
+    q = ((uintptr_t)ptr - rgn->start) / CACHE_QUANTUM;
+    count = cache_allocator_size_for_mask(dead->mask) / CACHE_QUANTUM;
+    if (q + count > rgn->quanta  ||  !cache_bitmap_test(rgn, q)) {
+        // uh-oh
+        _objc_inform("cache_allocator_free of non-pointer %p", ptr);
         return;
     }
 
-    // dead block belongs in the middle or end of free list
-    for (cur = rgn->freeList; cur != NULL; cur = cur->nextFree) {
-        cache_allocator_block *ahead = cur->nextFree;
-        
-        if (!ahead  ||  ahead > dead) {
-            // cur and ahead straddle dead, OR dead belongs at end of free list
-            cur->nextFree = dead;
-            dead->nextFree = ahead;
-            
-            // coalesce into dead first in case both succeed
-            cache_allocator_coalesce(dead);
-            cache_allocator_coalesce(cur);
-            return;
+    cache_bitmap_set(rgn, q, count, NO);
+    rgn->used -= count;
+}
+
+
+/***********************************************************************
+* cache_allocator_print_stats
+* Logs region usage and fragmentation for OBJC_PRINT_CACHE_SETUP.
+* Fragmentation is the fraction of free space in a region that is 
+* not part of its largest free run.
+* Cache locks: cacheUpdateLock must be held by the caller.
+**********************************************************************/
+static void cache_allocator_print_stats(void)
+{
+    cache_allocator_region *rgn;
+    size_t used_total = 0;
+    size_t free_total = 0;
+    size_t largest_total = 0;
+
+    mutex_assert_locked(&cacheUpdateLock);
+
+    for (rgn = cacheRegion; rgn != NULL; rgn = rgn->next) {
+        size_t q, run = 0, largest = 0;
+        size_t avail = rgn->quanta - rgn->used;
+
+        for (q = 0; q < rgn->quanta; q++) {
+            if (cache_bitmap_test(rgn, q)) {
+                run = 0;
+            } else if (++run > largest) {
+                largest = run;
+            }
         }
+
+        _objc_inform("CACHES: region %p: %4zu / %4zu quanta used, "
+                     "largest free run %4zu quanta, %3zu%% fragmented", 
+                     (void *)rgn->start, rgn->used, rgn->quanta, largest, 
+                     avail ? (avail - largest) * 100 / avail : 0);
+
+        used_total += rgn->used;
+        free_total += avail;
+        largest_total += largest;
     }
 
-    // uh-oh
-    _objc_inform("cache_allocator_free of non-pointer %p", ptr);
+    _objc_inform("CACHES: allocator: %zu regions, "
+                 "%zu / %zu bytes used/free, %zu%% fragmented", 
+                 cache_allocator_regions, 
+                 used_total * CACHE_QUANTUM, free_total * CACHE_QUANTUM, 
+                 free_total ? (free_total - largest_total) * 100 / free_total : 0);
 }
 
 // defined(CACHE_ALLOCATOR)
@@ -1244,15 +1467,6 @@ static void cache_allocator_free(void *ptr)
 * Cache instrumentation and debugging
 **********************************************************************/
 
-#ifdef OBJC_INSTRUMENTED
-enum {
-    CACHE_HISTOGRAM_SIZE    = 512
-};
-
-unsigned int    CacheHitHistogram [CACHE_HISTOGRAM_SIZE];
-unsigned int    CacheMissHistogram [CACHE_HISTOGRAM_SIZE];
-#endif
-
 
 /***********************************************************************
 * _cache_print.
@@ -215,7 +215,7 @@ static int            objcMsgLogEnabled    = 0;
 **********************************************************************/
 Class object_getClass(id obj)
 {
-    if (obj) return obj->isa;
+    if (obj) return _object_getIsa(obj);
     else return Nil;
 }
 
@@ -225,6 +225,9 @@ Class object_getClass(id obj)
 **********************************************************************/
 Class object_setClass(id obj, Class cls)
 {
+    // A tagged pointer's class is fixed by its tag.
+    if (obj  &&  _objc_isTaggedPointer(obj)) return Nil;
+
     if (obj) {
         Class old;
         do {
@@ -241,7 +244,7 @@ Class object_setClass(id obj, Class cls)
 **********************************************************************/
 const char *object_getClassName(id obj)
 {
-    if (obj) return _class_getName(obj->isa);
+    if (obj) return _class_getName(_object_getIsa(obj));
     else return "nil";
 }
 
@@ -251,8 +254,10 @@ const char *object_getClassName(id obj)
 void *object_getIndexedIvars(id obj)
 {
     // ivars are tacked onto the end of the object
-    if (obj) return ((char *) obj) + _class_getInstanceSize(obj->isa);
-    else return NULL;
+    if (obj  &&  !_objc_isTaggedPointer(obj)) {
+        return ((char *) obj) + _class_getInstanceSize(obj->isa);
+    }
+    return NULL;
 }
 
 
@@ -260,7 +265,7 @@ Ivar object_setInstanceVariable(id obj, const char *name, void *value)
 {
     Ivar ivar = NULL;
 
-    if (obj && name) {
+    if (obj && name && !_objc_isTaggedPointer(obj)) {
         if ((ivar = class_getInstanceVariable(obj->isa, name))) {
             objc_assign_ivar((id)value,obj,ivar_getOffset(ivar));
         }
@@ -270,7 +275,7 @@ Ivar object_setInstanceVariable(id obj, const char *name, void *value)
 
 Ivar object_getInstanceVariable(id obj, const char *name, void **value)
 {
-    if (obj && name) {
+    if (obj && name && !_objc_isTaggedPointer(obj)) {
         Ivar ivar;
         void **ivaridx;
         if ((ivar = class_getInstanceVariable(obj->isa, name))) {
@@ -286,7 +291,7 @@ Ivar object_getInstanceVariable(id obj, const char *name, void **value)
 
 void object_setIvar(id obj, Ivar ivar, id value)
 {
-    if (obj  &&  ivar) {
+    if (obj  &&  ivar  &&  !_objc_isTaggedPointer(obj)) {
         objc_assign_ivar(value, obj, ivar_getOffset(ivar));
     }
 }
@@ -294,7 +299,7 @@ void object_setIvar(id obj, Ivar ivar, id value)
 
 id object_getIvar(id obj, Ivar ivar)
 {
-    if (obj  &&  ivar) {
+    if (obj  &&  ivar  &&  !_objc_isTaggedPointer(obj)) {
         id *idx = (id *)((char *)obj + ivar_getOffset(ivar));
         return *idx;
     }
@@ -870,6 +875,7 @@ __private_extern__ IMP lookUpMethod(Class cls, SEL sel,
     IMP methodPC = NULL;
     Method meth;
     BOOL triedResolver = NO;
+    BOOL locked;
 
     // Optimistic cache lookup
     if (cache) {
@@ -886,8 +892,9 @@ __private_extern__ IMP lookUpMethod(Class cls, SEL sel,
     // with respect to method addition. Otherwise, a category could 
     // be added but ignored indefinitely because the cache was re-filled 
     // with the old value after the cache flush on behalf of the category.
+    // No lock is taken while the runtime is frozen: nothing can be added.
  retry:
-    lockForMethodLookup();
+    locked = lockForMethodLookup();
 
     // Try this class's cache.
 
@@ -936,7 +943,7 @@ __private_extern__ IMP lookUpMethod(Class cls, SEL sel,
     // No implementation found. Try method resolver once.
 
     if (!triedResolver) {
-        unlockForMethodLookup();
+        unlockForMethodLookup(locked);
         _class_resolveMethod(cls, sel);
         // Don't cache the result; we don't hold the lock so it may have 
         // changed already. Re-do the search from scratch instead.
@@ -951,7 +958,7 @@ __private_extern__ IMP lookUpMethod(Class cls, SEL sel,
     methodPC = &_objc_msgForward_internal;
 
  done:
-    unlockForMethodLookup();
+    unlockForMethodLookup(locked);
 
     // paranoia: look for ignored selectors with non-ignored implementations
     assert(!(sel == (SEL)kIgnore  &&  methodPC != (IMP)&_objc_ignored_method));
@@ -1180,17 +1187,25 @@ id objc_constructInstance(Class cls, void *bytes)
 * objc_destructInstance
 * Destroys an instance without freeing memory. 
 * Any C++ destructors are called. Any associative references are removed.
+* Any reference count kept by the root retain/release is dropped.
 * Returns `obj`. Does nothing if `obj` is nil.
 **********************************************************************/
 void *objc_destructInstance(id obj) 
 {
-    if (obj) {
+    if (obj  &&  !_objc_isTaggedPointer(obj)) {
         object_cxxDestruct(obj);
 
         // don't call this if the class has never had associative references.
         if (_class_instancesHaveAssociatedObjects(obj->isa)) {
             _object_remove_assocations(obj);
         }
+
+        // likewise for weak references.
+        if (_class_instancesHaveWeakReferrers(obj->isa)) {
+            _object_clear_weak_referrers(obj);
+        }
+
+        _object_clear_refcount(obj);
     }
 
     return obj;
@@ -1241,6 +1256,7 @@ __private_extern__ id
 _internal_object_dispose(id anObject) 
 {
     if (anObject==nil) return nil;
+    if (_objc_isTaggedPointer(anObject)) return nil;
 
     objc_destructInstance(anObject);
     
@@ -60,9 +60,7 @@
 #endif
 
 // Define NO_FIXUP to use non-fixup messaging for OBJC2.
-#if defined(__arm__)
-#   define NO_FIXUP 1
-#endif
+// (No architecture currently needs it; ARM has objc_msgSend_fixup.)
 
 // Define NO_VTABLE to disable vtable dispatch for OBJC2.
 #if defined(NO_FIXUP)  ||  defined(__ppc64__)
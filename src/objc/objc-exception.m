@@ -300,7 +300,7 @@ void objc_exception_throw(id obj)
 
     exc->tinfo.vtable = objc_ehtype_vtable+2;
     exc->tinfo.name = object_getClassName(obj);
-    exc->tinfo.cls = obj ? obj->isa : Nil;
+    exc->tinfo.cls = obj ? _object_getIsa(obj) : Nil;
 
     if (PrintExceptions) {
         _objc_inform("EXCEPTIONS: throwing %p (object %p, a %s)", 
@@ -74,63 +74,55 @@ _getObjcClassNames(const header_info *hi, size_t *size)
 
 #ifndef __LP64__
 #define SEGMENT_CMD LC_SEGMENT
-#define GETSECTDATAFROMHEADER(mh, seg, sect, sizep) \
-    getsectdatafromheader(mh, seg, sect, (uint32_t *)sizep)
 #else
 #define SEGMENT_CMD LC_SEGMENT_64
-#define GETSECTDATAFROMHEADER(mh, seg, sect, sizep) \
-    getsectdatafromheader_64(mh, seg, sect, (uint64_t *)sizep)
 #endif
 
+// Sections are located once per image when dyld registers it.
+static void *
+getSection(const header_info *hi, int sect, size_t entsize, size_t *count)
+{
+    const struct dyld_section *section = &hi->os.sections[sect];
+    *count = section->size / entsize;
+    if (!section->start) return NULL;
+    return (void *)((uintptr_t)section->start + hi->os.image_slide);
+}
+
 __private_extern__ objc_image_info *
 _getObjcImageInfo(const headerType *head, ptrdiff_t slide, size_t *sizep)
 {
-  objc_image_info *info = (objc_image_info *)
-      GETSECTDATAFROMHEADER(head, SEG_DATA, "__objc_imageinfo", sizep);
-  if (!info) info = (objc_image_info *)
-      GETSECTDATAFROMHEADER(head, SEG_OBJC, "__image_info", sizep);
+  const struct dyld_section *section = &head->sections[DYLD_SECT_IMAGEINFO];
+  objc_image_info *info = (objc_image_info *)section->start;
   // size is BYTES, not count!
+  *sizep = section->size;
   if (info) info = (objc_image_info *)((uintptr_t)info + slide);
   return info;
 }
 
 // fixme !objc2 only (used for new-abi paranoia)
+// ELF images have no __OBJC segment.
 __private_extern__ Module 
 _getObjcModules(const header_info *hi, size_t *nmodules)
 {
-  size_t size;
-  void *mods = 
-      GETSECTDATAFROMHEADER(hi->mhdr, SEG_OBJC, SECT_OBJC_MODULES, &size);
-  if (mods) mods = (void *)((uintptr_t)mods + hi->os.image_slide);
-  return (Module)mods;
+  if (nmodules) *nmodules = 0;
+  return NULL;
 }
 
 // fixme !objc2 only (used for new-abi paranoia)
 __private_extern__ SEL *
 _getObjcSelectorRefs(const header_info *hi, size_t *nmess)
 {
-  size_t size;
-  void *refs = 
-      GETSECTDATAFROMHEADER (hi->mhdr, SEG_OBJC, "__message_refs", &size);
-  if (refs) refs = (void *)((uintptr_t)refs + hi->os.image_slide);
-  *nmess = size / sizeof(SEL);
-  return (SEL *)refs;
+  *nmess = 0;
+  return NULL;
 }
 
 __private_extern__ BOOL
 _hasObjcContents(const header_info *hi)
 {
     // Look for a __DATA,__objc* section other than __DATA,__objc_imageinfo
-    const segmentType *seg = hi->os.dataSegmentHeader;
-    const sectionType *sect;
-    uint32_t i;
-    for (i = 0; i < seg->nsects; i++) {
-        sect = ((const sectionType *)(seg+1))+i;
-        if (0 == strncmp(sect->sectname, "__objc_", 7)  &&  
-            0 != strncmp(sect->sectname, "__objc_imageinfo", 16)) 
-        {
-            return YES;
-        }
+    int i;
+    for (i = DYLD_SECT_IMAGEINFO+1; i < DYLD_SECT_COUNT; i++) {
+        if (hi->os.sections[i].size) return YES;
     }
 
     return NO;
@@ -139,124 +131,79 @@ _hasObjcContents(const header_info *hi)
 __private_extern__ SEL *
 _getObjc2SelectorRefs(const header_info *hi, size_t *nmess)
 {
-  size_t size;
-  void *refs = 
-      GETSECTDATAFROMHEADER (hi->mhdr, SEG_DATA, "__objc_selrefs", &size);
-  if (refs) refs = (void *)((uintptr_t)refs + hi->os.image_slide);
-  *nmess = size / sizeof(SEL);
-  return (SEL *)refs;
+  return (SEL *)getSection(hi, DYLD_SECT_SELREFS, sizeof(SEL), nmess);
 }
 
 __private_extern__ message_ref *
 _getObjc2MessageRefs(const header_info *hi, size_t *nmess)
 {
-  size_t size;
-  void *refs = 
-      GETSECTDATAFROMHEADER (hi->mhdr, SEG_DATA, "__objc_msgrefs", &size);
-  if (refs) refs = (void *)((uintptr_t)refs + hi->os.image_slide);
-  *nmess = size / sizeof(message_ref);
-  return (message_ref *)refs;
+  return (message_ref *)
+      getSection(hi, DYLD_SECT_MSGREFS, sizeof(message_ref), nmess);
 }
 
 __private_extern__ struct class_t **
 _getObjc2ClassRefs(const header_info *hi, size_t *nclasses)
 {
-  size_t size;
-  void *classes = 
-      GETSECTDATAFROMHEADER(hi->mhdr, SEG_DATA, "__objc_classrefs", &size);
-  *nclasses = size / sizeof(struct class_t *);
-  if (classes) classes = (void *)((uintptr_t)classes + hi->os.image_slide);
-  return (struct class_t **)classes;
+  return (struct class_t **)
+      getSection(hi, DYLD_SECT_CLASSREFS, sizeof(struct class_t *), nclasses);
 }
 
 __private_extern__ struct class_t **
 _getObjc2SuperRefs(const header_info *hi, size_t *nclasses)
 {
-  size_t size;
-  void *classes = 
-      GETSECTDATAFROMHEADER(hi->mhdr, SEG_DATA, "__objc_superrefs", &size);
-  *nclasses = size / sizeof(struct class_t *);
-  if (classes) classes = (void *)((uintptr_t)classes + hi->os.image_slide);
-  return (struct class_t **)classes;
+  return (struct class_t **)
+      getSection(hi, DYLD_SECT_SUPERREFS, sizeof(struct class_t *), nclasses);
 }
 
 __private_extern__ struct class_t **
 _getObjc2ClassList(const header_info *hi, size_t *nclasses)
 {
-  size_t size;
-  void *classes = 
-      GETSECTDATAFROMHEADER(hi->mhdr, SEG_DATA, "__objc_classlist", &size);
-  *nclasses = size / sizeof(struct class_t *);
-  if (classes) classes = (void *)((uintptr_t)classes + hi->os.image_slide);
-  return (struct class_t **)classes;
+  return (struct class_t **)
+      getSection(hi, DYLD_SECT_CLASSLIST, sizeof(struct class_t *), nclasses);
 }
 
 __private_extern__ struct class_t **
 _getObjc2NonlazyClassList(const header_info *hi, size_t *nclasses)
 {
-  size_t size;
-  void *classes = 
-      GETSECTDATAFROMHEADER(hi->mhdr, SEG_DATA, "__objc_nlclslist", &size);
-  *nclasses = size / sizeof(struct class_t *);
-  if (classes) classes = (void *)((uintptr_t)classes + hi->os.image_slide);
-  return (struct class_t **)classes;
+  return (struct class_t **)
+      getSection(hi, DYLD_SECT_NLCLSLIST, sizeof(struct class_t *), nclasses);
 }
 
 __private_extern__ struct category_t **
 _getObjc2CategoryList(const header_info *hi, size_t *ncats)
 {
-  size_t size;
-  void *cats = 
-      GETSECTDATAFROMHEADER(hi->mhdr, SEG_DATA, "__objc_catlist", &size);
-  *ncats = size / sizeof(struct category_t *);
-  if (cats) cats = (void *)((uintptr_t)cats + hi->os.image_slide);
-  return (struct category_t **)cats;
+  return (struct category_t **)
+      getSection(hi, DYLD_SECT_CATLIST, sizeof(struct category_t *), ncats);
 }
 
 __private_extern__ struct category_t **
 _getObjc2NonlazyCategoryList(const header_info *hi, size_t *ncats)
 {
-  size_t size;
-  void *cats = 
-      GETSECTDATAFROMHEADER(hi->mhdr, SEG_DATA, "__objc_nlcatlist", &size);
-  *ncats = size / sizeof(struct category_t *);
-  if (cats) cats = (void *)((uintptr_t)cats + hi->os.image_slide);
-  return (struct category_t **)cats;
+  return (struct category_t **)
+      getSection(hi, DYLD_SECT_NLCATLIST, sizeof(struct category_t *), ncats);
 }
 
 __private_extern__ struct protocol_t **
 _getObjc2ProtocolList(const header_info *hi, size_t *nprotos)
 {
-  size_t size;
-  void *protos = 
-      GETSECTDATAFROMHEADER (hi->mhdr, SEG_DATA, "__objc_protolist", &size);
-  *nprotos = size / sizeof(struct protocol_t *);
-  if (protos) protos = (struct protocol_t **)((uintptr_t)protos+hi->os.image_slide);
-  return (struct protocol_t **)protos;
+  return (struct protocol_t **)
+      getSection(hi, DYLD_SECT_PROTOLIST, sizeof(struct protocol_t *), nprotos);
 }
 
 __private_extern__ struct protocol_t **
 _getObjc2ProtocolRefs(const header_info *hi, size_t *nprotos)
 {
-  size_t size;
-  void *protos = 
-      GETSECTDATAFROMHEADER (hi->mhdr, SEG_DATA, "__objc_protorefs", &size);
-  *nprotos = size / sizeof(struct protocol_t *);
-  if (protos) protos = (struct protocol_t **)((uintptr_t)protos+hi->os.image_slide);
-  return (struct protocol_t **)protos;
+  return (struct protocol_t **)
+      getSection(hi, DYLD_SECT_PROTOREFS, sizeof(struct protocol_t *), nprotos);
 }
 
 __private_extern__ const char *
 _getObjcHeaderName(const headerType *header)
 {
-    Dl_info info;
-
-    if (dladdr((void*)header, &info)) {
-        return info.dli_fname;
-    }
-    else {
-        return "??";
-    }
+    // header is dyld's stand-in for the image, not part of its 
+    // mapping, so dladdr() can't name it. Ask dyld instead.
+    const char *name = dyld_image_name(header);
+    return name[0] ? name : "<main executable>";
 }
 
 
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2011 Dmitry Skiba
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/***********************************************************************
+* objc-launch-cache.h
+* Selector fixups saved from a previous launch (OBJC_LAUNCH_CACHE).
+**********************************************************************/
+
+#ifndef _OBJC_LAUNCH_CACHE_H
+#define _OBJC_LAUNCH_CACHE_H
+
+#include "objc-private.h"
+
+__BEGIN_DECLS
+
+extern void launch_cache_init(void);
+extern BOOL launch_cache_fixupSelectorRefs(const header_info *hi, SEL *sels, size_t count);
+extern void launch_cache_recordSelectorRefs(const header_info *hi, SEL *sels, size_t count);
+extern uint32_t launch_cache_classCount(void);
+extern uint32_t launch_cache_protocolCount(void);
+extern void launch_cache_finish(void);
+
+__END_DECLS
+
+#endif
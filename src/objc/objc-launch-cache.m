@@ -0,0 +1,599 @@
+/*
+ * Copyright (C) 2011 Dmitry Skiba
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/***********************************************************************
+* objc-launch-cache.m
+* Selector fixups saved from a previous launch.
+*
+* When OBJC_LAUNCH_CACHE names a file, the runtime records the selector
+* fixups of every image loaded at launch and writes them to that file
+* once launch is finished (see call_dyld_handlers in android/dyld.m).
+* The file holds:
+*  - every distinct selector name used by those images, with its
+*    selector table hash, in order of first use;
+*  - for each image, in load order: its build-id, and the name index
+*    of each of its selector refs;
+*  - the number of named classes and protocols, to presize those tables.
+*
+* The next launch reads the file into memory. While images arrive in 
+* the recorded order with the recorded build-ids, their selector refs 
+* are fixed up from the file: each name is registered once with its 
+* saved hash, straight from the loaded file (no per-name copy), and 
+* each ref is a table lookup. Saved hashes are only trusted if the file 
+* was written with the same selector hash function: the header holds 
+* the hash of a fixed string, and a sample of the saved hashes is 
+* recomputed when the file is loaded. Either mismatch discards the file.
+*
+* At the first image that doesn't match, the cache is dropped for the 
+* rest of the launch, fixups go back to sel_registerName, and a new 
+* file is recorded, starting from the images that did match.
+*
+* The file is read rather than mapped, and the copy is never freed: 
+* registered selectors point into it, and a mapping would turn a later 
+* truncation of the file into SIGBUS on selector access.
+*
+* Locking: everything here runs with runtimeLock held for writing.
+**********************************************************************/
+
+#include "objc-private.h"
+#include "objc-launch-cache.h"
+#include <sys/stat.h>
+
+#define LAUNCH_CACHE_MAGIC      0x634c624f   /* 'ObLc' */
+#define LAUNCH_CACHE_VERSION    2
+#define LAUNCH_CACHE_BUILD_ID_MAX 32
+#define LAUNCH_CACHE_HASH_CHECK "objc launch cache selector hash"
+#define LAUNCH_CACHE_HASH_SAMPLES 16
+
+// Name index of a NULL selector ref.
+#define LAUNCH_CACHE_NULL_REF   0xffffffffU
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t hashCheck;         // _objc_strhash(LAUNCH_CACHE_HASH_CHECK)
+    uint32_t fileSize;
+    uint32_t imageCount;
+    uint32_t nameCount;
+    uint32_t refCount;
+    uint32_t classCount;
+    uint32_t protocolCount;
+    uint32_t imagesOffset;      // launch_cache_image[imageCount]
+    uint32_t hashesOffset;      // uint32_t[nameCount]
+    uint32_t nameOffsetsOffset; // uint32_t[nameCount], into names
+    uint32_t refsOffset;        // uint32_t[refCount], name indexes
+    uint32_t namesOffset;       // NUL-terminated names
+    uint32_t namesSize;
+} launch_cache_header;
+
+typedef struct {
+    uint8_t buildID[LAUNCH_CACHE_BUILD_ID_MAX];
+    uint32_t buildIDLength;
+    uint32_t refCount;
+    uint32_t firstRef;
+    uint32_t firstName;    // names first used by this image are
+    uint32_t nameCount;    // [firstName, firstName + nameCount)
+} launch_cache_image;
+
+enum {
+    LAUNCH_CACHE_UNINITIALIZED,
+    LAUNCH_CACHE_OFF,
+    LAUNCH_CACHE_USING,
+    LAUNCH_CACHE_RECORDING,
+    LAUNCH_CACHE_STOPPED    // recording stopped; write what was recorded
+};
+
+static int state = LAUNCH_CACHE_UNINITIALIZED;
+
+// The loaded file.
+static const launch_cache_header *cache;
+static const launch_cache_image *cacheImages;
+static const uint32_t *cacheHashes;
+static const uint32_t *cacheNameOffsets;
+static const uint32_t *cacheRefs;
+static const char *cacheNames;
+static uint32_t cacheImageIndex;   // next image expected
+static uint32_t cacheNameLimit;    // names registered so far
+static SEL *cacheSels;             // registered selector for each name
+
+// Fixups recorded in this launch.
+static NXMapTable *recordIndexes;  // SEL -> name index + 1
+static SEL *recordNames;
+static uint32_t *recordHashes;
+static uint32_t recordNameCount, recordNameCapacity;
+static uint32_t *recordRefs;
+static uint32_t recordRefCount, recordRefCapacity;
+static launch_cache_image *recordImages;
+static uint32_t recordImageCount, recordImageCapacity;
+static BOOL recordDirty;
+
+
+/***********************************************************************
+* loadCache
+* Reads and checks the cache file. Returns NO if there is no usable file.
+**********************************************************************/
+static BOOL loadCache(const char *path)
+{
+    struct stat st;
+    const launch_cache_header *h;
+    uint8_t *buffer;
+    size_t done;
+    uint32_t i, step;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return NO;
+    if (fstat(fd, &st) < 0  ||  st.st_size < (off_t)sizeof(*h)) {
+        close(fd);
+        return NO;
+    }
+    buffer = _malloc_internal(st.st_size);
+    for (done = 0; done < (size_t)st.st_size; ) {
+        ssize_t got = read(fd, buffer + done, st.st_size - done);
+        if (got < 0  &&  errno == EINTR) continue;
+        if (got <= 0) break;  // error, or the file shrank
+        done += got;
+    }
+    close(fd);
+    h = (const launch_cache_header *)buffer;
+    if (done != (size_t)st.st_size) goto bad;
+
+#define IN_FILE(offset, count, size) \
+    ((offset) % 4 == 0  &&  (offset) <= h->fileSize  &&  \
+     (uint64_t)(count) * (size) <= h->fileSize - (offset))
+
+    if (h->magic != LAUNCH_CACHE_MAGIC  ||
+        h->version != LAUNCH_CACHE_VERSION  ||
+        h->hashCheck != _objc_strhash(LAUNCH_CACHE_HASH_CHECK)  ||
+        h->fileSize != (uint64_t)st.st_size  ||
+        !IN_FILE(h->imagesOffset, h->imageCount, sizeof(launch_cache_image)) ||
+        !IN_FILE(h->hashesOffset, h->nameCount, sizeof(uint32_t))  ||
+        !IN_FILE(h->nameOffsetsOffset, h->nameCount, sizeof(uint32_t))  ||
+        !IN_FILE(h->refsOffset, h->refCount, sizeof(uint32_t))  ||
+        !IN_FILE(h->namesOffset, h->namesSize, 1)  ||
+        h->namesSize == 0  ||
+        ((const char *)h)[h->namesOffset + h->namesSize - 1] != '\0')
+    {
+        goto bad;
+    }
+#undef IN_FILE
+
+    cacheImages = (const launch_cache_image *)
+        ((const uint8_t *)h + h->imagesOffset);
+    cacheHashes = (const uint32_t *)((const uint8_t *)h + h->hashesOffset);
+    cacheNameOffsets = (const uint32_t *)
+        ((const uint8_t *)h + h->nameOffsetsOffset);
+    cacheRefs = (const uint32_t *)((const uint8_t *)h + h->refsOffset);
+    cacheNames = (const char *)h + h->namesOffset;
+
+    for (i = 0; i < h->nameCount; i++) {
+        if (cacheNameOffsets[i] >= h->namesSize) goto bad;
+    }
+
+    // Spot-check the saved hashes. Registering a name under the wrong 
+    // hash would put it in the wrong bucket of the selector table.
+    step = h->nameCount / LAUNCH_CACHE_HASH_SAMPLES + 1;
+    for (i = 0; i < h->nameCount; i += step) {
+        if (cacheHashes[i] != _objc_strhash(cacheNames+cacheNameOffsets[i])) {
+            goto bad;
+        }
+    }
+
+    cache = h;
+    return YES;
+
+ bad:
+    if (PrintImages) {
+        _objc_inform("IMAGES: ignoring bad launch cache %s", path);
+    }
+    _free_internal(buffer);
+    return NO;
+}
+
+
+/***********************************************************************
+* launch_cache_init
+* Loads the OBJC_LAUNCH_CACHE file, if any, and decides whether this
+* launch uses it or records a new one. Does nothing after the first call.
+* Locking: runtimeLock must be held for writing
+**********************************************************************/
+__private_extern__ void launch_cache_init(void)
+{
+    rwlock_assert_writing(&runtimeLock);
+
+    if (state != LAUNCH_CACHE_UNINITIALIZED) return;
+
+    if (!LaunchCacheFile) {
+        state = LAUNCH_CACHE_OFF;
+    }
+    else if (loadCache(LaunchCacheFile)) {
+        cacheSels = _calloc_internal(cache->nameCount + 1, sizeof(SEL));
+        state = LAUNCH_CACHE_USING;
+        if (PrintImages) {
+            _objc_inform("IMAGES: using launch cache %s (%u images, "
+                         "%u selectors)", LaunchCacheFile,
+                         cache->imageCount, cache->nameCount);
+        }
+    }
+    else {
+        state = LAUNCH_CACHE_RECORDING;
+        if (PrintImages) {
+            _objc_inform("IMAGES: no usable launch cache; recording %s",
+                         LaunchCacheFile);
+        }
+    }
+}
+
+
+/***********************************************************************
+* Recording.
+**********************************************************************/
+#define GROW(array, count, capacity, initial) \
+    if ((count) == (capacity)) { \
+        (capacity) = (capacity) ? (capacity) * 2 : (initial); \
+        (array) = _realloc_internal((array), (capacity) * sizeof(*(array))); \
+    }
+
+static uint32_t recordName(SEL sel, uint32_t hash)
+{
+    if (recordNameCount == recordNameCapacity) {
+        recordNameCapacity = recordNameCapacity ? recordNameCapacity*2 : 1024;
+        recordNames = _realloc_internal(recordNames, 
+                                        recordNameCapacity * sizeof(SEL));
+        recordHashes = _realloc_internal(recordHashes, 
+                                         recordNameCapacity * sizeof(uint32_t));
+    }
+    recordNames[recordNameCount] = sel;
+    recordHashes[recordNameCount] = hash;
+    NXMapInsert(recordIndexes, sel, (void *)(uintptr_t)(recordNameCount + 1));
+    return recordNameCount++;
+}
+
+static void recordRef(uint32_t index)
+{
+    GROW(recordRefs, recordRefCount, recordRefCapacity, 4096);
+    recordRefs[recordRefCount++] = index;
+}
+
+static launch_cache_image *recordImage(void)
+{
+    GROW(recordImages, recordImageCount, recordImageCapacity, 64);
+    return &recordImages[recordImageCount++];
+}
+
+
+/***********************************************************************
+* stopUsingCache
+* Called when an image doesn't match the cache. Starts recording,
+* seeded with the images that did match.
+**********************************************************************/
+static void stopUsingCache(const header_info *hi)
+{
+    uint32_t i;
+
+    if (PrintImages) {
+        _objc_inform("IMAGES: launch cache doesn't match %s; "
+                     "recording a new one", _nameForHeader(hi->mhdr));
+    }
+
+    state = LAUNCH_CACHE_RECORDING;
+    recordIndexes = NXCreateMapTableFromZone(NXPtrValueMapPrototype,
+                                             cacheNameLimit + 1024,
+                                             _objc_internal_zone());
+    for (i = 0; i < cacheNameLimit; i++) {
+        recordName(cacheSels[i], cacheHashes[i]);
+    }
+    for (i = 0; i < cacheImageIndex; i++) {
+        const launch_cache_image *img = &cacheImages[i];
+        uint32_t r;
+        *recordImage() = *img;
+        for (r = 0; r < img->refCount; r++) {
+            recordRef(cacheRefs[img->firstRef + r]);
+        }
+    }
+
+    _free_internal(cacheSels);
+    cacheSels = NULL;
+}
+
+
+/***********************************************************************
+* launch_cache_fixupSelectorRefs
+* Fixes up the image's selector refs from the cache if the image is
+* the next one the cache expects. Returns NO if the caller must fix
+* them up itself.
+* Locking: runtimeLock and selLock must be held for writing
+**********************************************************************/
+__private_extern__ BOOL
+launch_cache_fixupSelectorRefs(const header_info *hi, SEL *sels, size_t count)
+{
+    const launch_cache_image *img;
+    const uint8_t *buildID;
+    uint32_t buildIDLength;
+    uint32_t limit;
+    size_t i;
+
+    launch_cache_init();
+    if (state != LAUNCH_CACHE_USING) return NO;
+
+    if (cacheImageIndex == cache->imageCount) {
+        stopUsingCache(hi);
+        return NO;
+    }
+    img = &cacheImages[cacheImageIndex];
+
+    // Same image as last time?
+    buildID = dyld_image_build_id(hi->mhdr, &buildIDLength);
+    if (!buildID  ||  buildIDLength != img->buildIDLength  ||
+        buildIDLength > LAUNCH_CACHE_BUILD_ID_MAX  ||
+        0 != memcmp(buildID, img->buildID, buildIDLength)  ||
+        count != img->refCount  ||
+        img->firstName != cacheNameLimit  ||
+        img->nameCount > cache->nameCount - cacheNameLimit  ||
+        img->firstRef > cache->refCount  ||
+        img->refCount > cache->refCount - img->firstRef)
+    {
+        stopUsingCache(hi);
+        return NO;
+    }
+
+    // Check every ref before changing anything.
+    limit = img->firstName + img->nameCount;
+    for (i = 0; i < count; i++) {
+        uint32_t index = cacheRefs[img->firstRef + i];
+        if (index >= limit  &&  index != LAUNCH_CACHE_NULL_REF) {
+            stopUsingCache(hi);
+            return NO;
+        }
+    }
+
+    // Register the names this image introduced.
+    // A name that is already registered keeps its existing selector.
+    for (i = img->firstName; i < limit; i++) {
+        cacheSels[i] =
+            sel_registerNameHashedNoLock(cacheNames + cacheNameOffsets[i],
+                                         cacheHashes[i], NO);
+    }
+    cacheNameLimit = limit;
+
+    for (i = 0; i < count; i++) {
+        uint32_t index = cacheRefs[img->firstRef + i];
+        sels[i] = (index == LAUNCH_CACHE_NULL_REF) ? NULL : cacheSels[index];
+    }
+
+    cacheImageIndex++;
+    return YES;
+}
+
+
+/***********************************************************************
+* launch_cache_recordSelectorRefs
+* Records the image's selector refs after they have been fixed up.
+* Images must be recorded in the order they were fixed up.
+* Locking: runtimeLock must be held for writing
+**********************************************************************/
+__private_extern__ void
+launch_cache_recordSelectorRefs(const header_info *hi, SEL *sels, size_t count)
+{
+    launch_cache_image *img;
+    const uint8_t *buildID;
+    uint32_t buildIDLength;
+    size_t i;
+
+    launch_cache_init();
+    if (state != LAUNCH_CACHE_RECORDING) return;
+
+    buildID = dyld_image_build_id(hi->mhdr, &buildIDLength);
+    if (!buildID  ||  buildIDLength > LAUNCH_CACHE_BUILD_ID_MAX) {
+        // Later images can't be matched without this one.
+        // Keep what is recorded so far.
+        if (PrintImages) {
+            _objc_inform("IMAGES: %s has no build-id; launch cache "
+                         "stops before it", _nameForHeader(hi->mhdr));
+        }
+        state = LAUNCH_CACHE_STOPPED;
+        return;
+    }
+
+    if (!recordIndexes) {
+        recordIndexes = NXCreateMapTableFromZone(NXPtrValueMapPrototype,
+                                                 4096,
+                                                 _objc_internal_zone());
+    }
+
+    img = recordImage();
+    bzero(img, sizeof(*img));
+    memcpy(img->buildID, buildID, buildIDLength);
+    img->buildIDLength = buildIDLength;
+    img->refCount = (uint32_t)count;
+    img->firstRef = recordRefCount;
+    img->firstName = recordNameCount;
+
+    for (i = 0; i < count; i++) {
+        SEL sel = sels[i];
+        uint32_t index;
+        if (!sel) {
+            index = LAUNCH_CACHE_NULL_REF;
+        } else {
+            uintptr_t value = (uintptr_t)NXMapGet(recordIndexes, sel);
+            if (value) index = (uint32_t)(value - 1);
+            else index = recordName(sel, _objc_strhash((const char *)sel));
+        }
+        recordRef(index);
+    }
+
+    // recordImages may have moved
+    img = &recordImages[recordImageCount - 1];
+    img->nameCount = recordNameCount - img->firstName;
+    recordDirty = YES;
+}
+
+
+/***********************************************************************
+* launch_cache_classCount
+* launch_cache_protocolCount
+* Number of named classes and protocols at the end of the recorded
+* launch, or 0 if unknown. Used to presize those tables.
+* Locking: runtimeLock must be held
+**********************************************************************/
+__private_extern__ uint32_t launch_cache_classCount(void)
+{
+    return cache ? cache->classCount : 0;
+}
+
+__private_extern__ uint32_t launch_cache_protocolCount(void)
+{
+    return cache ? cache->protocolCount : 0;
+}
+
+
+/***********************************************************************
+* writeCache
+* Writes the recorded fixups to path, replacing it atomically.
+**********************************************************************/
+static BOOL writeAll(int fd, const void *data, size_t size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return NO;
+        }
+        p += written;
+        size -= written;
+    }
+    return YES;
+}
+
+static void writeCache(const char *path,
+                       uint32_t classCount, uint32_t protocolCount)
+{
+    launch_cache_header h;
+    uint32_t *nameOffsets;
+    uint32_t namesSize;
+    uint32_t i;
+    static const uint8_t zeros[4] = {0};
+    BOOL ok;
+    int fd;
+
+    nameOffsets = _malloc_internal((recordNameCount + 1) * sizeof(uint32_t));
+    namesSize = 0;
+    for (i = 0; i < recordNameCount; i++) {
+        nameOffsets[i] = namesSize;
+        namesSize += (uint32_t)strlen((const char *)recordNames[i]) + 1;
+    }
+    if (namesSize == 0) {
+        nameOffsets[0] = 0;
+        namesSize = 1;  // one empty name keeps the file well-formed
+    }
+
+    bzero(&h, sizeof(h));
+    h.magic = LAUNCH_CACHE_MAGIC;
+    h.version = LAUNCH_CACHE_VERSION;
+    h.hashCheck = _objc_strhash(LAUNCH_CACHE_HASH_CHECK);
+    h.imageCount = recordImageCount;
+    h.nameCount = recordNameCount;
+    h.refCount = recordRefCount;
+    h.classCount = classCount;
+    h.protocolCount = protocolCount;
+    h.imagesOffset = sizeof(h);
+    h.hashesOffset = h.imagesOffset +
+        recordImageCount * sizeof(launch_cache_image);
+    h.nameOffsetsOffset = h.hashesOffset + recordNameCount * sizeof(uint32_t);
+    h.refsOffset = h.nameOffsetsOffset + recordNameCount * sizeof(uint32_t);
+    h.namesOffset = h.refsOffset + recordRefCount * sizeof(uint32_t);
+    h.namesSize = namesSize;
+    h.fileSize = h.namesOffset + ((namesSize + 3) & ~3);
+
+    char tmpPath[strlen(path) + 5];
+    strcpy(tmpPath, path);
+    strcat(tmpPath, ".tmp");
+
+    fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    ok = (fd >= 0);
+    ok = ok && writeAll(fd, &h, sizeof(h));
+    ok = ok && writeAll(fd, recordImages,
+                        recordImageCount * sizeof(launch_cache_image));
+    ok = ok && writeAll(fd, recordHashes, recordNameCount * sizeof(uint32_t));
+    ok = ok && writeAll(fd, nameOffsets, recordNameCount * sizeof(uint32_t));
+    ok = ok && writeAll(fd, recordRefs, recordRefCount * sizeof(uint32_t));
+    for (i = 0; ok  &&  i < recordNameCount; i++) {
+        const char *name = (const char *)recordNames[i];
+        ok = writeAll(fd, name, strlen(name) + 1);
+    }
+    if (recordNameCount == 0) ok = ok && writeAll(fd, zeros, 1);
+    ok = ok && writeAll(fd, zeros, ((namesSize + 3) & ~3) - namesSize);
+    if (fd >= 0  &&  close(fd) < 0) ok = NO;
+    ok = ok && (0 == rename(tmpPath, path));
+
+    if (!ok) {
+        if (fd >= 0) unlink(tmpPath);
+        _objc_inform("could not write launch cache %s (errno %d)",
+                     path, errno);
+    }
+    else if (PrintImages) {
+        _objc_inform("IMAGES: wrote launch cache %s (%u images, "
+                     "%u selectors, %u bytes)", path,
+                     recordImageCount, recordNameCount, h.fileSize);
+    }
+
+    _free_internal(nameOffsets);
+}
+
+
+/***********************************************************************
+* launch_cache_finish
+* Called once all images present at launch have been processed.
+* Writes a new cache file if this launch recorded one. Images loaded
+* later are not cached.
+* Locking: acquires runtimeLock
+**********************************************************************/
+__private_extern__ void launch_cache_finish(void)
+{
+    rwlock_write(&runtimeLock);
+
+    launch_cache_init();
+
+    if ((state == LAUNCH_CACHE_RECORDING  ||  state == LAUNCH_CACHE_STOPPED)
+        &&  recordDirty) 
+    {
+        writeCache(LaunchCacheFile,
+                   _objc_namedClassCount(), _objc_protocolCount());
+    }
+
+    if (recordIndexes) NXFreeMapTable(recordIndexes);
+    if (recordNames) _free_internal(recordNames);
+    if (recordHashes) _free_internal(recordHashes);
+    if (recordRefs) _free_internal(recordRefs);
+    if (recordImages) _free_internal(recordImages);
+    if (cacheSels) _free_internal(cacheSels);
+    recordIndexes = NULL;
+    recordNames = NULL;
+    recordHashes = NULL;
+    recordRefs = NULL;
+    recordImages = NULL;
+    cacheSels = NULL;
+    recordNameCount = recordNameCapacity = 0;
+    recordRefCount = recordRefCapacity = 0;
+    recordImageCount = recordImageCapacity = 0;
+    recordDirty = NO;
+
+    // Keep the loaded cache: registered selectors point into it.
+    state = LAUNCH_CACHE_OFF;
+
+    rwlock_unlock_write(&runtimeLock);
+}
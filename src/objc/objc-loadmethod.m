@@ -198,7 +198,17 @@ static void call_class_loads(void)
         if (PrintLoading) {
             _objc_inform("LOAD: +[%s load]\n", _class_getName(cls));
         }
-        (*load_method) ((id) cls, SEL_load);
+        if (StartupTimesEnabled) {
+            char detail[256];
+            uint64_t start = _objc_startupTimeNow();
+            (*load_method) ((id) cls, SEL_load);
+            snprintf(detail, sizeof(detail), "+[%s load]", 
+                     _class_getName(cls));
+            _objc_logStartupTime("+load", NULL, detail, 
+                                 _objc_startupTimeNow() - start);
+        } else {
+            (*load_method) ((id) cls, SEL_load);
+        }
     }
     
     // Destroy the detached list.
@@ -245,7 +255,17 @@ static BOOL call_category_loads(void)
                              _class_getName(cls), 
                              _category_getName(cat));
             }
-            (*load_method) ((id) cls, SEL_load);
+            if (StartupTimesEnabled) {
+                char detail[256];
+                uint64_t start = _objc_startupTimeNow();
+                (*load_method) ((id) cls, SEL_load);
+                snprintf(detail, sizeof(detail), "+[%s(%s) load]", 
+                         _class_getName(cls), _category_getName(cat));
+                _objc_logStartupTime("+load", NULL, detail, 
+                                     _objc_startupTimeNow() - start);
+            } else {
+                (*load_method) ((id) cls, SEL_load);
+            }
             cats[i].cat = NULL;
         }
     }
@@ -341,6 +361,8 @@ __private_extern__ void call_load_methods(void)
     if (loading) return;
     loading = YES;
 
+    uint64_t start = StartupTimesEnabled ? _objc_startupTimeNow() : 0;
+
     do {
         // 1. Repeatedly call class +loads until there aren't any more
         while (loadable_classes_used > 0) {
@@ -353,6 +375,11 @@ __private_extern__ void call_load_methods(void)
         // 3. Run more +loads if there are classes OR more untried categories
     } while (loadable_classes_used > 0  ||  more_categories);
 
+    if (StartupTimesEnabled) {
+        _objc_logStartupTime("call_load_methods", NULL, NULL, 
+                             _objc_startupTimeNow() - start);
+    }
+
     loading = NO;
 }
 
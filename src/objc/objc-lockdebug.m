@@ -479,6 +479,11 @@ _rwlock_assert_reading_debug(rwlock_t *lock, const char *name)
 {
     _objc_lock_list *locks = getLocks(NO);
 
+    // Readers skip runtimeLock and selLock while the runtime is frozen.
+    if (RuntimeFrozen  &&  (lock == &runtimeLock  ||  lock == &selLock)) {
+        return;
+    }
+
     if (! (DebuggerMode  &&  isManagedDuringDebugger(lock))) {
         if (!hasLock(locks, lock, RDLOCK)) {
             _objc_fatal("rwlock %s incorrectly not reading\n", name+1);
@@ -503,6 +508,11 @@ _rwlock_assert_locked_debug(rwlock_t *lock, const char *name)
 {
     _objc_lock_list *locks = getLocks(NO);
 
+    // Readers skip runtimeLock and selLock while the runtime is frozen.
+    if (RuntimeFrozen  &&  (lock == &runtimeLock  ||  lock == &selLock)) {
+        return;
+    }
+
     if (! (DebuggerMode  &&  isManagedDuringDebugger(lock))) {
         if (!hasLock(locks, lock, RDLOCK)  &&  !hasLock(locks, lock, WRLOCK)) {
             _objc_fatal("rwlock %s incorrectly neither reading nor writing\n", 
@@ -42,6 +42,8 @@
 #include <assert.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
 
 #include "android/dyld.h"
 
@@ -267,6 +269,8 @@ typedef struct {
     const segmentType * objcSegmentHeader;
     const segmentType * dataSegmentHeader;
     ptrdiff_t           image_slide;
+    // Objective-C sections, located once by dyld (see android/dyld.h)
+    const struct dyld_section * sections;
 } os_header_info;
 
 // Prototypes
@@ -277,9 +277,7 @@ static header_info * _objc_addHeader(const headerType *mhdr)
     if (bad_magic(mhdr)) return NULL;
 
     // Weed out duplicates
-    for (result = FirstHeader; result; result = result->next) {
-        if (mhdr == result->mhdr) return NULL;
-    }
+    if (_headerForMachHeader(mhdr)) return NULL;
 
     // Locate the __OBJC segment
     image_slide = _getImageSlide(mhdr);
@@ -297,6 +295,7 @@ static header_info * _objc_addHeader(const headerType *mhdr)
     result->os.image_slide = image_slide;
     result->os.objcSegmentHeader = objc_segment;
     result->os.dataSegmentHeader = data_segment;
+    result->os.sections = mhdr->sections;
     result->info = image_info;
     dladdr((void*)result->mhdr, &result->os.dl_info);
     result->allClassesRealized = NO;
@@ -363,6 +362,7 @@ map_images_nolock(enum dyld_image_states state, uint32_t infoCount,
     header_info *hi;
     header_info *hList[infoCount];
     uint32_t hCount;
+    uint64_t start = StartupTimesEnabled ? _objc_startupTimeNow() : 0;
 
     // Perform first-time initialization if necessary.
     // This function is called before ordinary library initializers. 
@@ -408,6 +408,14 @@ map_images_nolock(enum dyld_image_states state, uint32_t infoCount,
 
     _read_images(hList, hCount);
 
+    if (StartupTimesEnabled) {
+        char detail[64];
+        snprintf(detail, sizeof(detail), "%u images, %u with objc", 
+                 infoCount, hCount);
+        _objc_logStartupTime("map_images", NULL, detail, 
+                             _objc_startupTimeNow() - start);
+    }
+
     firstTime = NO;
 
     return NULL;
@@ -430,13 +438,11 @@ load_images_nolock(enum dyld_image_states state,uint32_t infoCount,
 
     i = infoCount;
     while (i--) {
-        header_info *hi;
-        for (hi = FirstHeader; hi != NULL; hi = hi->next) {
-            const headerType *mhdr = (headerType*)infoList[i].imageLoadAddress;
-            if (hi->mhdr == mhdr) {
-                prepare_load_methods(hi);
-                found = YES;
-            }
+        const headerType *mhdr = (headerType*)infoList[i].imageLoadAddress;
+        header_info *hi = _headerForMachHeader(mhdr);
+        if (hi) {
+            prepare_load_methods(hi);
+            found = YES;
         }
     }
 
@@ -462,11 +468,7 @@ unmap_image_nolock(const struct mach_header *mh, intptr_t vmaddr_slide)
     header_info *hi;
     
     // Find the runtime's header_info struct for the image
-    for (hi = FirstHeader; hi != NULL; hi = hi->next) {
-        if (hi->mhdr == (const headerType *)mh) {
-            break;
-        }
-    }
+    hi = _headerForMachHeader((const headerType *)mh);
 
     if (!hi) return;
 
@@ -507,37 +509,6 @@ void _objc_init(void)
 }
 
 
-/***********************************************************************
-* _headerForAddress.
-* addr can be a class or a category
-**********************************************************************/
-static const header_info *_headerForAddress(void *addr)
-{
-    unsigned long            size;
-    unsigned long            seg;
-    header_info *        hi;
-
-    // Check all headers in the vector
-    for (hi = FirstHeader; hi != NULL; hi = hi->next)
-    {
-        // Locate header data, if any
-        const segmentType *segHeader;
-        segHeader = hi->os.dataSegmentHeader;
-        if (!segHeader) continue;
-        seg = segHeader->vmaddr + hi->os.image_slide;
-        size = segHeader->filesize;
-
-        // Is the class in this header?
-        if ((seg <= (unsigned long) addr) &&
-            ((unsigned long) addr < (seg + size)))
-            return hi;
-    }
-
-    // Not found
-    return 0;
-}
-
-
 /***********************************************************************
 * _headerForClass
 * Return the image header containing this class, or NULL.
@@ -634,6 +605,166 @@ __private_extern__ int secure_open(const char *filename, int flags, uid_t euid)
 }
 #endif
 
+/***********************************************************************
+* _objc_parallel_apply
+* Calls work(context, begin, end) over disjoint ranges covering 
+* [0, count), using up to one thread per online CPU. Each thread gets 
+* at least minPerThread items; smaller jobs run on the calling thread. 
+* The calling thread does the first range itself. Returns when all 
+* ranges are done.
+* work must not take runtimeLock, selLock or any other runtime lock 
+* that the caller might hold, and must not call back into the runtime 
+* except for functions documented as safe for this.
+* OBJC_DISABLE_PARALLEL_IMAGES forces everything onto the calling thread.
+* Locking: none
+**********************************************************************/
+#define PARALLEL_MAX_THREADS 8
+
+typedef struct {
+    objc_parallel_work_t work;
+    void *context;
+    size_t begin;
+    size_t end;
+} parallel_range;
+
+static void *parallel_thread(void *arg)
+{
+    parallel_range *range = (parallel_range *)arg;
+    range->work(range->context, range->begin, range->end);
+    return NULL;
+}
+
+__private_extern__ void 
+_objc_parallel_apply(size_t count, size_t minPerThread, 
+                     objc_parallel_work_t work, void *context)
+{
+    static long cpus = 0;
+    parallel_range ranges[PARALLEL_MAX_THREADS];
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    BOOL started[PARALLEL_MAX_THREADS];
+    size_t threadCount;
+    size_t i;
+
+    if (count == 0) return;
+
+    if (!cpus) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cpus < 1) cpus = 1;
+    }
+
+    threadCount = count / (minPerThread ? minPerThread : 1);
+    if (threadCount > (size_t)cpus) threadCount = cpus;
+    if (threadCount > PARALLEL_MAX_THREADS) threadCount = PARALLEL_MAX_THREADS;
+    if (DisableParallelImages) threadCount = 1;
+
+    if (threadCount <= 1) {
+        work(context, 0, count);
+        return;
+    }
+
+    for (i = 0; i < threadCount; i++) {
+        ranges[i].work = work;
+        ranges[i].context = context;
+        ranges[i].begin = count * i / threadCount;
+        ranges[i].end = count * (i+1) / threadCount;
+    }
+
+    // Start helpers for ranges 1..n-1. If a thread can't be created, 
+    // its range is done on this thread instead.
+    for (i = 1; i < threadCount; i++) {
+        started[i] = (0 == pthread_create(&threads[i], NULL, 
+                                          parallel_thread, &ranges[i]));
+    }
+
+    parallel_thread(&ranges[0]);
+
+    for (i = 1; i < threadCount; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else parallel_thread(&ranges[i]);
+    }
+}
+
+
+/***********************************************************************
+* objc_printForkSharing
+* Logs how many pages of Objective-C images and of the malloc heap are 
+* shared with other processes (a prefork parent and its children) and 
+* how many are private to this one, as counted in /proc/self/smaps.
+* Locking: read-locks runtimeLock
+**********************************************************************/
+typedef struct {
+    unsigned long sharedKB;
+    unsigned long privateCleanKB;
+    unsigned long privateDirtyKB;
+} fork_sharing;
+
+static void printForkSharing(const char *what, const fork_sharing *fs)
+{
+    unsigned long pageKB = getpagesize() / 1024;
+    _objc_inform("FORK: %s: %lu pages shared, %lu pages private "
+                 "(%lu dirty)", what, fs->sharedKB / pageKB, 
+                 (fs->privateCleanKB + fs->privateDirtyKB) / pageKB, 
+                 fs->privateDirtyKB / pageKB);
+}
+
+void objc_printForkSharing(void)
+{
+    FILE *f;
+    char line[512];
+    fork_sharing images = {0, 0, 0};
+    fork_sharing heap = {0, 0, 0};
+    fork_sharing *current = NULL;
+
+    f = fopen("/proc/self/smaps", "r");
+    if (!f) {
+        _objc_inform("FORK: could not open /proc/self/smaps (errno %d)", 
+                     errno);
+        return;
+    }
+
+    rwlock_read(&runtimeLock);
+
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long start, end, kb;
+        char name[256];
+
+        // Mapping header: "start-end perms offset dev inode [name]"
+        name[0] = '\0';
+        if (sscanf(line, "%lx-%lx %*s %*s %*s %*s %255s", 
+                   &start, &end, name) >= 2) 
+        {
+            if (_headerForAddress((void *)start)) {
+                current = &images;
+            } else if (0 == strcmp(name, "[heap]")  ||  
+                       0 == strncmp(name, "[anon:libc_malloc", 17)) 
+            {
+                current = &heap;
+            } else {
+                current = NULL;
+            }
+            continue;
+        }
+
+        if (!current) continue;
+        if (1 == sscanf(line, "Shared_Clean: %lu", &kb)  ||  
+            1 == sscanf(line, "Shared_Dirty: %lu", &kb)) 
+        {
+            current->sharedKB += kb;
+        } else if (1 == sscanf(line, "Private_Clean: %lu", &kb)) {
+            current->privateCleanKB += kb;
+        } else if (1 == sscanf(line, "Private_Dirty: %lu", &kb)) {
+            current->privateDirtyKB += kb;
+        }
+    }
+
+    rwlock_unlock_read(&runtimeLock);
+    fclose(f);
+
+    printForkSharing("Objective-C images", &images);
+    printForkSharing("malloc heap", &heap);
+}
+
+
 /***********************************************************************
 * _objc_internal_zone.
 * Malloc zone for internal runtime data.
@@ -53,6 +53,26 @@ typedef struct {
     SEL sel;
 } message_ref;
 
+// Vtable and fixup trampolines, described for the debugger. 
+// See gdb_objc_trampolines in objc-runtime-new.m.
+typedef struct {
+    uint32_t offset;  // 0 = unused, else code = (uintptr_t)desc + desc->offset
+    uint32_t flags;
+} objc_trampoline_descriptor;
+#define OBJC_TRAMPOLINE_MESSAGE (1<<0)   // trampoline acts like objc_msgSend
+#define OBJC_TRAMPOLINE_STRET   (1<<1)   // trampoline is struct-returning
+#define OBJC_TRAMPOLINE_VTABLE  (1<<2)   // trampoline is vtable dispatcher
+
+typedef struct objc_trampoline_header {
+    uint16_t headerSize;  // sizeof(objc_trampoline_header)
+    uint16_t descSize;    // sizeof(objc_trampoline_descriptor)
+    uint32_t descCount;   // number of descriptors following this header
+    struct objc_trampoline_header *next;
+} objc_trampoline_header;
+
+// Selector value for methods that are ignored (never registered without GC).
+#define kIgnore 0xfffeb010
+
 typedef struct objc_module *Module;
 typedef struct objc_cache *Cache;
 
@@ -224,6 +244,8 @@ extern int HeaderCount;
 
 extern void _objc_appendHeader(header_info *hi);
 extern void _objc_removeHeader(header_info *hi);
+extern header_info *_headerForMachHeader(const headerType *mhdr);
+extern header_info *_headerForAddress(const void *addr);
 extern const char *_nameForHeader(const headerType*);
 
 extern objc_image_info *_getObjcImageInfo(const headerType *head, ptrdiff_t slide, size_t *size);
@@ -251,6 +273,8 @@ extern struct protocol_t **_getObjc2ProtocolRefs(const header_info *head, size_t
 /* selectors */
 extern void sel_init(BOOL gc);
 extern SEL sel_registerNameNoLock(const char *str, BOOL copy);
+extern SEL sel_lookupNameNoLock(const char *str, uint32_t *outHash);
+extern SEL sel_registerNameHashedNoLock(const char *str, uint32_t hash, BOOL copy);
 extern void sel_lock(void);
 extern void sel_unlock(void);
 extern BOOL sel_preoptimizationValid(const header_info *hi);
@@ -265,6 +289,10 @@ extern SEL SEL_cxx_destruct;
 extern SEL SEL_retain;
 extern SEL SEL_release;
 extern SEL SEL_autorelease;
+extern SEL SEL_retainCount;
+extern SEL SEL_dealloc;
+extern SEL SEL_allowsWeakReference;
+extern SEL SEL_retainWeakReference;
 extern SEL SEL_copy;
 extern SEL SEL_finalize;
 
@@ -281,9 +309,13 @@ extern void _free_internal(void *ptr);
 
 extern Class _calloc_class(size_t size);
 
+/* worker threads for startup work */
+typedef void (*objc_parallel_work_t)(void *context, size_t begin, size_t end);
+extern void _objc_parallel_apply(size_t count, size_t minPerThread, objc_parallel_work_t work, void *context);
+
 extern IMP lookUpMethod(Class, SEL, BOOL initialize, BOOL cache);
-extern void lockForMethodLookup(void);
-extern void unlockForMethodLookup(void);
+extern BOOL lockForMethodLookup(void);
+extern void unlockForMethodLookup(BOOL locked);
 extern IMP prepareForMethodLookup(Class cls, SEL sel, BOOL initialize);
 
 extern IMP _cache_getImp(Class cls, SEL sel);
@@ -328,6 +360,9 @@ extern rwlock_t runtimeLock;
 extern mutex_t classLock;
 extern mutex_t methodListLock;
 
+/* Set by objc_freezeRuntime(); only changes with runtimeLock write-held. */
+extern volatile BOOL RuntimeFrozen;
+
 /* Debugger mode for gdb */
 #define DEBUGGER_OFF 0
 #define DEBUGGER_PARTIAL 1
@@ -439,6 +474,19 @@ extern void _rwlock_assert_unlocked_debug(rwlock_t *l, const char *name);
         else if ((s) == RDWR) rwlock_unlock_write(m); \
     } while (0)
 
+/* Readers of runtimeLock and selLock skip the lock while the runtime is 
+ * frozen. `locked` records whether the lock was taken, for the unlock. */
+#define rwlock_read_unless_frozen(m, locked)          \
+    do {                                              \
+        (locked) = !RuntimeFrozen;                    \
+        if (locked) rwlock_read(m);                   \
+    } while (0)
+
+#define rwlock_unlock_read_if_locked(m, locked)       \
+    do {                                              \
+        if (locked) rwlock_unlock_read(m);            \
+    } while (0)
+
 
 extern NXHashTable *class_hash;
 
@@ -503,6 +551,8 @@ ENV(PrintExceptions);           // env OBJC_PRINT_EXCEPTIONS
 ENV(PrintDeprecation);          // env OBJC_PRINT_DEPRECATION_WARNINGS
 ENV(PrintReplacedMethods);      // env OBJC_PRINT_REPLACED_METHODS
 ENV(PrintCaches);               // env OBJC_PRINT_CACHE_SETUP
+ENV(PrintStartupTimes);         // env OBJC_PRINT_STARTUP_TIMES
+ENV(PrintMethodFixups);         // env OBJC_PRINT_METHOD_FIXUPS
 ENV(UseInternalZone);           // env OBJC_USE_INTERNAL_ZONE
 
 ENV(DebugUnload);               // env OBJC_DEBUG_UNLOAD
@@ -512,8 +562,28 @@ ENV(DebugNilSync);              // env OBJC_DEBUG_NIL_SYNC
 
 ENV(DisableVtables);            // env OBJC_DISABLE_VTABLES
 ENV(DisablePreopt);             // env OBJC_DISABLE_PREOPTIMIZATION
+ENV(DisableParallelImages);     // env OBJC_DISABLE_PARALLEL_IMAGES
+ENV(LazyMethodization);         // env OBJC_LAZY_METHODIZATION
 #undef ENV
 
+// Settings from environment variables that take a value
+#if NO_ENVIRON
+#   define VtableSelectorsFile ((const char *)NULL)
+#   define LaunchCacheFile ((const char *)NULL)
+#   define StartupTimesFile ((const char *)NULL)
+#   define ForkSelectorsFile ((const char *)NULL)
+#else
+extern const char *VtableSelectorsFile;  // env OBJC_VTABLE_SELECTORS
+extern const char *LaunchCacheFile;      // env OBJC_LAUNCH_CACHE
+extern const char *StartupTimesFile;     // env OBJC_STARTUP_TIMES_FILE
+extern const char *ForkSelectorsFile;    // env OBJC_FORK_SELECTORS
+#endif
+
+// Startup timing (OBJC_PRINT_STARTUP_TIMES, OBJC_STARTUP_TIMES_FILE)
+#define StartupTimesEnabled (PrintStartupTimes  ||  StartupTimesFile)
+extern uint64_t _objc_startupTimeNow(void);
+extern void _objc_logStartupTime(const char *phase, const header_info *hi, const char *detail, uint64_t nanoseconds);
+
 extern void logReplacedMethod(const char *className, SEL s, BOOL isMeta, const char *catName, IMP oldImp, IMP newImp);
 
 
@@ -536,12 +606,26 @@ static __inline uint32_t _objc_strhash(const char *s) {
 }
 
 
+// Tagged pointers (layout in objc-internal.h; objc-msg-arm.S knows it too)
+extern Class _objc_tagged_isa_table[_OBJC_TAG_SLOT_COUNT];
+extern void _objc_taggedPointerSlotError(unsigned slot) __attribute__((noreturn));
+
+// obj->isa for any non-nil object, tagged or not.
+static __inline Class _object_getIsa(id obj) {
+    if (_objc_isTaggedPointer(obj)) {
+        return _objc_tagged_isa_table[_objc_getTaggedPointerSlot(obj)];
+    }
+    return obj->isa;
+}
+
+
 // objc per-thread storage
 typedef struct {
     struct _objc_initializing_classes *initializingClasses; // for +initialize
     struct _objc_lock_list *lockList;  // for lock debugging
     struct SyncCache *syncCache;  // for @synchronize
     struct alt_handler_list *handlerList;  // for exception alt handlers
+    struct autorelease_page *autoreleasePage;  // hot autorelease pool page
 
     // If you add new fields here, don't forget to update 
     // _objc_pthread_destroyspecific()
@@ -551,6 +635,10 @@ typedef struct {
 extern _objc_pthread_data *_objc_fetch_pthread_data(BOOL create);
 extern void tls_init(void);
 
+/* autorelease pools */
+extern id _objc_autoreleasePoolAdd(id obj);
+extern void _destroyAutoreleasePages(_objc_pthread_data *data);
+
 
 
 // Attribute for global variables to keep them out of bss storage
@@ -566,6 +654,9 @@ extern void flush_caches(Class cls, BOOL flush_meta);
 extern void flush_cache(Class cls);
 extern BOOL _cache_fill(Class cls, Method smt, SEL sel);
 extern void _cache_addForwardEntry(Class cls, SEL sel);
+extern void _cache_bumpMethodGeneration(void);
+struct objc_ic_slot;
+extern IMP _cache_fillICSlot(id self, struct objc_ic_slot *slot);
 extern void _cache_free(Cache cache);
 
 extern mutex_t cacheUpdateLock;
@@ -614,6 +705,8 @@ extern void _read_images(header_info **hList, uint32_t hCount);
 extern void prepare_load_methods(header_info *hi);
 extern void _unload_image(header_info *hi);
 extern const char ** _objc_copyClassNamesForImage(header_info *hi, unsigned int *outCount);
+extern uint32_t _objc_namedClassCount(void);
+extern uint32_t _objc_protocolCount(void);
 
 extern Class _objc_allocateFutureClass(const char *name);
 
@@ -650,7 +743,11 @@ extern BOOL _class_hasCxxStructorsNoSuper(Class cls);
 extern BOOL _class_shouldFinalizeOnMainThread(Class cls);
 extern void _class_setFinalizeOnMainThread(Class cls);
 extern BOOL _class_instancesHaveAssociatedObjects(Class cls);
+extern BOOL _class_hasDefaultRR(Class cls);
+extern BOOL _class_supportsCustomWeak(Class cls, BOOL methodize);
 extern void _class_assertInstancesHaveAssociatedObjects(Class cls);
+extern BOOL _class_instancesHaveWeakReferrers(Class cls);
+extern void _class_assertInstancesHaveWeakReferrers(Class cls);
 extern BOOL _class_shouldGrowCache(Class cls);
 extern void _class_setGrowCache(Class cls, BOOL grow);
 extern Ivar _class_getVariable(Class cls, const char *name);
@@ -36,6 +36,8 @@ __BEGIN_DECLS
 extern void _object_set_associative_reference(id object, void *key, id value, uintptr_t policy);
 extern id _object_get_associative_reference(id object, void *key);
 extern void _object_remove_assocations(id object);
+extern void _object_clear_refcount(id object);
+extern void _object_clear_weak_referrers(id object);
 
 __END_DECLS
 
@@ -29,6 +29,7 @@
 #include "objc-private.h"
 #include <objc/message.h>
 #include <map>
+#include <vector>
 #include <ext/hash_map>
 
 using namespace __gnu_cxx;
@@ -160,6 +161,14 @@ namespace objc_references_support {
     };
     typedef hash_map<void *, ObjectAssociationMap *, ObjcPointerHash, ObjcPointerEqual, ObjcAllocator<void *> > AssociationsHashMap;
 #endif
+
+    // object pointer -> retain count minus one. Objects with a count 
+    // of one have no entry.
+    typedef hash_map<void *, uintptr_t, ObjcPointerHash, ObjcPointerEqual, ObjcAllocator<void *> > RefcountHashMap;
+
+    // object pointer -> locations of __weak variables pointing to it.
+    typedef std::vector<id *, ObjcAllocator<id *> > WeakReferrers;
+    typedef hash_map<void *, WeakReferrers, ObjcPointerHash, ObjcPointerEqual, ObjcAllocator<void *> > WeakHashMap;
 }
 
 using namespace objc_references_support;
@@ -210,12 +219,12 @@ __private_extern__ id _object_get_associative_reference(id object, void *key) {
                 ObjcAssociation &entry = j->second;
                 value = (id)entry.value;
                 policy = entry.policy;
-                if (policy & OBJC_ASSOCIATION_GETTER_RETAIN) objc_msgSend(value, SEL_retain);
+                if (policy & OBJC_ASSOCIATION_GETTER_RETAIN) objc_retain(value);
             }
         }
     }
     if (value && (policy & OBJC_ASSOCIATION_GETTER_AUTORELEASE)) {
-        objc_msgSend(value, SEL_autorelease);
+        objc_autorelease(value);
     }
     return value;
 }
@@ -223,7 +232,7 @@ __private_extern__ id _object_get_associative_reference(id object, void *key) {
 static id acquireValue(id value, uintptr_t policy) {
     switch (policy & 0xFF) {
     case OBJC_ASSOCIATION_SETTER_RETAIN:
-        return objc_msgSend(value, SEL_retain);
+        return objc_retain(value);
     case OBJC_ASSOCIATION_SETTER_COPY:
         return objc_msgSend(value, SEL_copy);
     }
@@ -232,7 +241,7 @@ static id acquireValue(id value, uintptr_t policy) {
 
 static void releaseValue(id value, uintptr_t policy) {
     if (policy & OBJC_ASSOCIATION_SETTER_RETAIN) {
-        objc_msgSend(value, SEL_release);
+        objc_release(value);
     }
 }
 
@@ -270,7 +279,7 @@ __private_extern__ void _object_set_associative_reference(id object, void *key,
                 ObjectAssociationMap *refs = new ObjectAssociationMap;
                 associations[object] = refs;
                 (*refs)[key] = ObjcAssociation(policy, new_value);
-                _class_assertInstancesHaveAssociatedObjects(object->isa);
+                _class_assertInstancesHaveAssociatedObjects(_object_getIsa(object));
             }
         } else {
             // setting the association to nil breaks the association.
@@ -312,3 +321,318 @@ __private_extern__ void _object_remove_assocations(id object) {
     // the calls to releaseValue() happen outside of the lock.
     for_each(elements.begin(), elements.end(), ReleaseValue());
 }
+
+
+// Per-object side tables (reference counts, weak referrers) are split 
+// into shards, each with its own lock, so that threads working on 
+// unrelated objects rarely contend.
+
+enum { SIDE_TABLE_SHARD_COUNT = 64 };
+
+static inline uintptr_t sideTableIndex(void *object) {
+    uintptr_t k = (uintptr_t)object;
+    return ((k >> 4) ^ (k >> 10)) & (SIDE_TABLE_SHARD_COUNT - 1);
+}
+
+// Reference counts for classes using the root retain/release live in a 
+// side table; there are no spare bits in isa to keep them inline.
+
+// count stored for an object that is being deallocated
+#define DEALLOCATING (~(uintptr_t)0)
+
+class RefcountManager {
+    struct Shard {
+        OSSpinLock lock;
+        RefcountHashMap *map;
+    };
+    static Shard _shards[SIDE_TABLE_SHARD_COUNT];
+    Shard &_shard;
+public:
+    static volatile bool used;  // set once any count is stored
+
+    RefcountManager(void *object) : _shard(_shards[sideTableIndex(object)]) { 
+        OSSpinLockLock(&_shard.lock); 
+    }
+    ~RefcountManager() { OSSpinLockUnlock(&_shard.lock); }
+
+    RefcountHashMap &refcounts() {
+        if (_shard.map == NULL)
+            _shard.map = new(::_malloc_internal(sizeof(RefcountHashMap))) RefcountHashMap();
+        return *_shard.map;
+    }
+};
+
+RefcountManager::Shard RefcountManager::_shards[SIDE_TABLE_SHARD_COUNT];
+volatile bool RefcountManager::used = false;
+
+id _objc_rootRetain(id object, SEL _cmd) {
+    if (_objc_isTaggedPointer(object)) return object;
+    RefcountManager manager(object);
+    uintptr_t &count = manager.refcounts()[object];
+    if (count != DEALLOCATING) count++;
+    RefcountManager::used = true;
+    return object;
+}
+
+// Retains object unless it is already being deallocated.
+static bool rootTryRetain(id object) {
+    RefcountManager manager(object);
+    uintptr_t &count = manager.refcounts()[object];
+    RefcountManager::used = true;
+    if (count == DEALLOCATING) return false;
+    count++;
+    return true;
+}
+
+void _objc_rootRelease(id object, SEL _cmd) {
+    if (_objc_isTaggedPointer(object)) return;
+    {
+        RefcountManager manager(object);
+        RefcountHashMap &refcounts(manager.refcounts());
+        RefcountHashMap::iterator i = refcounts.find(object);
+        if (i != refcounts.end()) {
+            if (i->second == DEALLOCATING) return;
+            if (--i->second == 0) refcounts.erase(i);
+            return;
+        }
+        // Weak loads must not resurrect it; _object_clear_refcount 
+        // removes the mark.
+        if (_class_instancesHaveWeakReferrers(object->isa)) {
+            refcounts[object] = DEALLOCATING;
+            RefcountManager::used = true;
+        }
+    }
+    // dealloc outside of the lock.
+    objc_msgSend(object, SEL_dealloc);
+}
+
+uintptr_t _objc_rootRetainCount(id object, SEL _cmd) {
+    RefcountManager manager(object);
+    RefcountHashMap &refcounts(manager.refcounts());
+    RefcountHashMap::iterator i = refcounts.find(object);
+    if (i == refcounts.end()  ||  i->second == DEALLOCATING) return 1;
+    return i->second + 1;
+}
+
+id _objc_rootAutorelease(id object, SEL _cmd) {
+    if (_objc_isTaggedPointer(object)) return object;
+    return _objc_autoreleasePoolAdd(object);
+}
+
+// Drops any count left for a deallocating object, e.g. one sent -dealloc 
+// directly, so the entry doesn't outlive it and land on the next object 
+// allocated at the same address.
+__private_extern__ void _object_clear_refcount(id object) {
+    if (!RefcountManager::used) return;
+    RefcountManager manager(object);
+    if (manager.refcounts().size() == 0) return;
+    manager.refcounts().erase(object);
+}
+
+id objc_retain(id object) {
+    if (!object  ||  _objc_isTaggedPointer(object)) return object;
+    if (_class_hasDefaultRR(object->isa)) return _objc_rootRetain(object, SEL_retain);
+    return objc_msgSend(object, SEL_retain);
+}
+
+void objc_release(id object) {
+    if (!object  ||  _objc_isTaggedPointer(object)) return;
+    if (_class_hasDefaultRR(object->isa)) {
+        _objc_rootRelease(object, SEL_release);
+        return;
+    }
+    objc_msgSend(object, SEL_release);
+}
+
+id objc_autorelease(id object) {
+    if (!object  ||  _objc_isTaggedPointer(object)) return object;
+    if (_class_hasDefaultRR(object->isa)) return _objc_rootAutorelease(object, SEL_autorelease);
+    return objc_msgSend(object, SEL_autorelease);
+}
+
+id objc_retainAutorelease(id object) {
+    return objc_autorelease(objc_retain(object));
+}
+
+
+// Zeroing weak references. Each shard maps an object to the locations 
+// of the weak variables that point to it; objc_destructInstance clears 
+// them (only for classes that ever had a weak referrer). A variable is 
+// registered under its current object's shard, so storing a new object 
+// locks the shards of both the old and the new one.
+
+class WeakManager {
+    struct Shard {
+        OSSpinLock lock;
+        WeakHashMap *map;
+    };
+    static Shard _shards[SIDE_TABLE_SHARD_COUNT];
+    Shard *_first, *_second;
+
+    static Shard *shardFor(void *object) {
+        return &_shards[sideTableIndex(object)];
+    }
+public:
+    // Locks the shards of the non-NULL objects, in address order.
+    WeakManager(void *object1, void *object2 = NULL) {
+        _first = object1 ? shardFor(object1) : NULL;
+        _second = object2 ? shardFor(object2) : NULL;
+        if (!_first) { _first = _second; _second = NULL; }
+        if (_second == _first) _second = NULL;
+        if (_second  &&  _second < _first) { Shard *t = _first; _first = _second; _second = t; }
+        if (_first) OSSpinLockLock(&_first->lock);
+        if (_second) OSSpinLockLock(&_second->lock);
+    }
+    ~WeakManager() {
+        if (_second) OSSpinLockUnlock(&_second->lock);
+        if (_first) OSSpinLockUnlock(&_first->lock);
+    }
+
+    // object's shard must be locked by this manager.
+    WeakHashMap &referrers(void *object) {
+        Shard *shard = shardFor(object);
+        if (shard->map == NULL)
+            shard->map = new(::_malloc_internal(sizeof(WeakHashMap))) WeakHashMap();
+        return *shard->map;
+    }
+};
+
+WeakManager::Shard WeakManager::_shards[SIDE_TABLE_SHARD_COUNT];
+
+static void weakUnregister(WeakManager &manager, id object, id *location) {
+    WeakHashMap &referrers(manager.referrers(object));
+    WeakHashMap::iterator i = referrers.find(object);
+    if (i == referrers.end()) return;
+    WeakReferrers &locations = i->second;
+    for (WeakReferrers::iterator j = locations.begin(), end = locations.end(); j != end; ++j) {
+        if (*j == location) {
+            *j = locations.back();
+            locations.pop_back();
+            break;
+        }
+    }
+    if (locations.empty()) referrers.erase(i);
+}
+
+static void weakRegister(WeakManager &manager, id object, id *location) {
+    manager.referrers(object)[object].push_back(location);
+}
+
+// Weak variables never register tagged pointers; those are never deallocated.
+static inline bool weakTracked(id object) {
+    return object  &&  !_objc_isTaggedPointer(object);
+}
+
+// The runtime can't see the counts of classes with their own 
+// retain/release. Weak references to their instances are only formed 
+// if the class implements -allowsWeakReference (NO once the instance 
+// is deallocating) and -retainWeakReference (retains unless the 
+// instance is deallocating, returns NO otherwise). Both are sent with 
+// the object's shard locked, and must not use weak references.
+// With a shard locked, only class flags are checked: a method search 
+// could take runtimeLock. objc_storeWeak methodizes the class first.
+static bool customRRSupportsWeak(Class cls, bool shardLocked) {
+    return _class_supportsCustomWeak(cls, shardLocked ? NO : YES);
+}
+
+static bool isDeallocating(id object) {
+    if (!_class_hasDefaultRR(object->isa)) return false;
+    RefcountManager manager(object);
+    RefcountHashMap &refcounts(manager.refcounts());
+    RefcountHashMap::iterator i = refcounts.find(object);
+    return i != refcounts.end()  &&  i->second == DEALLOCATING;
+}
+
+id objc_storeWeak(id *location, id newObj) {
+    id oldObj;
+    // Storing an object that is already being deallocated stores nil.
+    if (weakTracked(newObj)  &&  isDeallocating(newObj)) newObj = nil;
+    if (weakTracked(newObj)  &&  !_class_hasDefaultRR(newObj->isa)  &&  
+        !customRRSupportsWeak(newObj->isa, false))
+    {
+        _objc_inform("cannot form weak reference to instance (%p) of class "
+                     "%s: it has its own retain/release but doesn't "
+                     "implement -allowsWeakReference and "
+                     "-retainWeakReference", newObj, 
+                     object_getClassName(newObj));
+        newObj = nil;
+    }
+    while (1) {
+        oldObj = *location;
+        WeakManager manager(weakTracked(oldObj) ? oldObj : NULL, 
+                            weakTracked(newObj) ? newObj : NULL);
+        // retry if another thread changed the variable meanwhile.
+        if (*location != oldObj) continue;
+        if (weakTracked(oldObj)) weakUnregister(manager, oldObj, location);
+        // Holding the shard lock keeps a deallocation that is about to 
+        // start from clearing referrers before newObj is registered.
+        if (weakTracked(newObj)  &&  !_class_hasDefaultRR(newObj->isa)  &&  
+            (!customRRSupportsWeak(newObj->isa, true)  ||  
+             !((BOOL(*)(id, SEL))objc_msgSend)(newObj, SEL_allowsWeakReference)))
+        {
+            newObj = nil;
+        }
+        if (weakTracked(newObj)) {
+            weakRegister(manager, newObj, location);
+            _class_assertInstancesHaveWeakReferrers(newObj->isa);
+        }
+        *location = newObj;
+        return newObj;
+    }
+}
+
+id objc_initWeak(id *location, id obj) {
+    *location = nil;
+    return objc_storeWeak(location, obj);
+}
+
+void objc_destroyWeak(id *location) {
+    objc_storeWeak(location, nil);
+}
+
+id objc_loadWeakRetained(id *location) {
+    while (1) {
+        id object = *location;
+        if (!weakTracked(object)) return object;
+        WeakManager manager(object);
+        // retry if another thread changed the variable meanwhile.
+        if (*location != object) continue;
+        // Holding the shard lock keeps object from being cleared, and 
+        // so freed, until it is retained.
+        if (_class_hasDefaultRR(object->isa)) {
+            return rootTryRetain(object) ? object : nil;
+        }
+        // The class may have got its own retain/release after object 
+        // was stored; without -retainWeakReference it can't be loaded.
+        if (!customRRSupportsWeak(object->isa, true)  ||  
+            !((BOOL(*)(id, SEL))objc_msgSend)(object, SEL_retainWeakReference))
+        {
+            return nil;
+        }
+        return object;
+    }
+}
+
+id objc_loadWeak(id *location) {
+    return objc_autorelease(objc_loadWeakRetained(location));
+}
+
+// Sets every weak variable pointing to a deallocating object to nil.
+__private_extern__ void _object_clear_weak_referrers(id object) {
+    WeakManager manager(object);
+    WeakHashMap &referrers(manager.referrers(object));
+    WeakHashMap::iterator i = referrers.find(object);
+    if (i == referrers.end()) return;
+    WeakReferrers &locations = i->second;
+    for (WeakReferrers::iterator j = locations.begin(), end = locations.end(); j != end; ++j) {
+        id *location = *j;
+        if (*location == object) {
+            *location = nil;
+        } else {
+            _objc_inform("__weak variable at %p holds %p instead of %p; "
+                         "it was assigned without objc_storeWeak", 
+                         location, *location, object);
+        }
+    }
+    referrers.erase(i);
+}
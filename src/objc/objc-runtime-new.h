@@ -68,6 +68,20 @@
 #define RW_SPECIALIZED_VTABLE (1<<22)
 // class instances may have associative references
 #define RW_INSTANCES_HAVE_ASSOCIATED_OBJECTS (1<<21)
+// class method, property and protocol lists are built (see methodizeClass)
+#define RW_METHODIZED         (1<<20)
+// class and all superclasses use the root retain/release (see objc_retain)
+#define RW_HAS_DEFAULT_RR     (1<<19)
+// class instances may have weak referrers
+#define RW_INSTANCES_HAVE_WEAK_REFERRERS (1<<18)
+// class is realized and realizeClass has finished with it
+#define RW_REALIZED_COMPLETE  (1<<17)
+// class or a superclass implements -allowsWeakReference
+#define RW_HAS_ALLOWS_WEAK_REFERENCE  (1<<16)
+// class or a superclass implements -retainWeakReference
+#define RW_HAS_RETAIN_WEAK_REFERENCE  (1<<15)
+#define RW_WEAK_REFERENCE_HOOKS \
+    (RW_HAS_ALLOWS_WEAK_REFERENCE | RW_HAS_RETAIN_WEAK_REFERENCE)
 
 typedef struct method_t {
     SEL name;
@@ -142,7 +156,11 @@ typedef struct class_rw_t {
 
     const class_ro_t *ro;
     
+    // NULL-terminated, newest lists first. Capacity includes the NULL 
+    // and leaves headroom for categories attached later.
     struct method_list_t **methods;
+    uint32_t methodListCount;
+    uint32_t methodListCapacity;
     struct chained_property_list *properties;
     struct protocol_list_t ** protocols;
 
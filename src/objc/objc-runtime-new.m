@@ -29,6 +29,7 @@
 
 #include "objc-private.h"
 #include "objc-runtime-new.h"
+#include "objc-launch-cache.h"
 #include <objc/message.h>
 
 #define newcls(cls) ((struct class_t *)cls)
@@ -53,8 +54,14 @@ static struct class_t *getSuperclass(struct class_t *cls);
 static void unload_class(class_t *cls, BOOL isMeta);
 static class_t *setSuperclass(class_t *cls, class_t *newSuper);
 static class_t *realizeClass(class_t *cls);
+static void methodizeClassIfNeeded(class_t *cls);
+static void prepareForMethodQuery(class_t *cls);
 static void flushCaches(class_t *cls);
 static void flushVtables(class_t *cls);
+static BOOL isRRSelector(SEL sel);
+static BOOL classHasDefaultRR(class_t *cls);
+static void clearDefaultRR(class_t *cls);
+static void addWeakReferenceHooks(class_t *cls, uint32_t hooks);
 static method_t *getMethodNoSuper_nolock(struct class_t *cls, SEL sel);
 static method_t *getMethod_nolock(class_t *cls, SEL sel);
 static void changeInfo(class_t *cls, unsigned int set, unsigned int clear);
@@ -68,6 +75,7 @@ static IMP _method_getImplementation(method_t *m);
 **********************************************************************/
 __private_extern__ rwlock_t runtimeLock = {0};
 __private_extern__ rwlock_t selLock = {0};
+__private_extern__ volatile BOOL RuntimeFrozen = NO;
 __private_extern__ mutex_t cacheUpdateLock = MUTEX_INITIALIZER;
 __private_extern__ recursive_mutex_t loadMethodLock = RECURSIVE_MUTEX_INITIALIZER;
 static int debugger_runtimeLock;
@@ -415,6 +423,19 @@ static void check_vtable_size(void)
       jmp  objc_msgSend    // fixme long branches
   }
   
+  arm
+
+  vtable dispatch (self a1, sel* a2, temp ip) {
+      teq   a1, #0
+      moveq a2, #0
+      bxeq  lr                   // nil check
+      ldr   ip, [a1, #ISA]
+      ldr   a2, [a2, #4]         // load _cmd
+      ldr   ip, [ip, #VTABLE]
+      ldr   ip, [ip, #index*4]   // 12-bit immediate, patched
+      bx    ip
+  }
+
 */
 extern uint8_t vtable_prototype;
 extern uint8_t vtable_ignored;
@@ -430,6 +451,11 @@ static size_t makeVtableTrampoline(uint8_t *dst, size_t index)
     uint16_t *p = (uint16_t *)(dst + vtable_prototype_index_offset + 3);
     if (*p != 0x7fff) _objc_fatal("vtable_prototype busted");
     *p = index * 8;
+#elif defined(__arm__)
+    // ldr ip, [ip, #0xffc] -> ldr ip, [ip, #index*4]
+    uint32_t *p = (uint32_t *)(dst + vtable_prototype_index_offset);
+    if ((*p & 0xfff) != 0xffc) _objc_fatal("vtable_prototype busted");
+    *p = (*p & ~0xfff) | (index * 4);
 #else
 #   warning unknown architecture
 #endif
@@ -438,6 +464,134 @@ static size_t makeVtableTrampoline(uint8_t *dst, size_t index)
 }
 
 
+/***********************************************************************
+* loadSelectorProfile
+* Reads a selector profile (OBJC_VTABLE_SELECTORS, OBJC_FORK_SELECTORS).
+* Each line is a selector name, optionally preceded by the number of 
+* sends seen for it in a message-send sampling run. Blank lines and 
+* lines starting with '#' are ignored. Selectors are ordered by 
+* descending send count (file order for ties), duplicates are dropped, 
+* and at most max are kept. tag prefixes any log message.
+* Returns the selector names, or NULL if the file has none.
+* The names and the array are allocated with _malloc_internal.
+* Locking: none
+**********************************************************************/
+typedef struct {
+    unsigned long count;
+    size_t order;
+    char *name;
+} selector_profile_entry;
+
+static int selector_profile_compare(const void *a, const void *b)
+{
+    const selector_profile_entry *e1 = (const selector_profile_entry *)a;
+    const selector_profile_entry *e2 = (const selector_profile_entry *)b;
+    if (e1->count != e2->count) return (e1->count > e2->count) ? -1 : 1;
+    if (e1->order != e2->order) return (e1->order < e2->order) ? -1 : 1;
+    return 0;
+}
+
+static const char **loadSelectorProfile(const char *path, size_t max, 
+                                        const char *tag, size_t *outCount)
+{
+    FILE *f;
+    char line[1024];
+    selector_profile_entry *entries = NULL;
+    size_t entryCount = 0;
+    size_t entryCapacity = 0;
+    const char **names;
+    size_t nameCount;
+    size_t i, j;
+
+    *outCount = 0;
+
+    f = fopen(path, "r");
+    if (!f) {
+        _objc_inform("%s: could not open selector file %s (errno %d)", 
+                     tag, path, errno);
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line;
+        char *end;
+        unsigned long count = 0;
+
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0'  ||  *p == '#') continue;
+
+        if (isdigit((unsigned char)*p)) {
+            count = strtoul(p, &p, 10);
+            while (isspace((unsigned char)*p)) p++;
+            if (*p == '\0') continue;
+        }
+
+        end = p;
+        while (*end  &&  !isspace((unsigned char)*end)) end++;
+        *end = '\0';
+
+        if (entryCount == entryCapacity) {
+            entryCapacity = entryCapacity ? entryCapacity * 2 : 64;
+            entries = _realloc_internal(entries, 
+                                        entryCapacity * sizeof(*entries));
+        }
+        entries[entryCount].count = count;
+        entries[entryCount].order = entryCount;
+        entries[entryCount].name = _strdup_internal(p);
+        entryCount++;
+    }
+    fclose(f);
+
+    if (entryCount == 0) {
+        _objc_inform("%s: no selectors in selector file %s", tag, path);
+        _free_internal(entries);
+        return NULL;
+    }
+
+    qsort(entries, entryCount, sizeof(*entries), selector_profile_compare);
+
+    if (max > entryCount) max = entryCount;
+    names = _malloc_internal(max * sizeof(const char *));
+    nameCount = 0;
+    for (i = 0; i < entryCount; i++) {
+        BOOL keep = (nameCount < max);
+        for (j = 0; keep  &&  j < nameCount; j++) {
+            if (0 == strcmp(names[j], entries[i].name)) keep = NO;
+        }
+        if (keep) names[nameCount++] = entries[i].name;
+        else _free_internal(entries[i].name);
+    }
+    _free_internal(entries);
+
+    *outCount = nameCount;
+    return names;
+}
+
+
+#ifdef OBJC_INSTRUMENTED
+// Incremented by the messengers in objc-msg-arm.S.
+extern uint32_t _objc_vtableDispatchCount;
+extern uint32_t _objc_cacheDispatchCount;
+
+/***********************************************************************
+* printVtableStatistics
+* Reports how many sends were served by vtable dispatch and how many 
+* went through the method cache. Registered with atexit() by 
+* initVtables() when OBJC_PRINT_VTABLE_SETUP is set.
+**********************************************************************/
+static void printVtableStatistics(void)
+{
+    uint32_t vtableSends = _objc_vtableDispatchCount;
+    uint32_t cacheSends = _objc_cacheDispatchCount;
+    uint64_t total = (uint64_t)vtableSends + cacheSends;
+
+    _objc_inform("VTABLES: %u sends by vtable dispatch, %u by method cache "
+                 "(%.1f%% vtable)", vtableSends, cacheSends, 
+                 total ? 100.0 * vtableSends / total : 0.0);
+}
+#endif
+
+
 static void initVtables(void)
 {
     if (DisableVtables) {
@@ -450,11 +604,23 @@ static void initVtables(void)
         return;
     }
 
-    const char * const *names;
+    const char * const *names = NULL;
     size_t i;
 
-    names = defaultVtable;
-    vtableCount = sizeof(defaultVtable) / sizeof(defaultVtable[0]);
+    if (VtableSelectorsFile) {
+        names = loadSelectorProfile(VtableSelectorsFile, vtableMax, 
+                                    "VTABLES", &vtableCount);
+        if (!names) {
+            _objc_inform("VTABLES: using default vtable selectors");
+        } else if (PrintVtables) {
+            _objc_inform("VTABLES: %zu vtable selectors from %s", 
+                         vtableCount, VtableSelectorsFile);
+        }
+    }
+    if (!names) {
+        names = defaultVtable;
+        vtableCount = sizeof(defaultVtable) / sizeof(defaultVtable[0]);
+    }
     if (vtableCount > vtableMax) vtableCount = vtableMax;
 
     vtableSelectors = _malloc_internal(vtableCount * sizeof(SEL));
@@ -484,13 +650,17 @@ static void initVtables(void)
             vtableCount - defaultVtableTrampolineCount;
 
         const int align = 16;
-        size_t codeSize = 
-            round_page(sizeof(objc_trampoline_header) + align + 
-                       generatedCount * (sizeof(objc_trampoline_descriptor) 
-                                         + vtable_prototype_size + align));
+        size_t pageSize = getpagesize();
+        size_t codeSize = sizeof(objc_trampoline_header) + align + 
+            generatedCount * (sizeof(objc_trampoline_descriptor) 
+                              + vtable_prototype_size + align);
+        codeSize = (codeSize + pageSize - 1) & ~(pageSize - 1);
         void *codeAddr = mmap(0, codeSize, PROT_READ|PROT_WRITE, 
-                              MAP_PRIVATE|MAP_ANON, 
-                              VM_MAKE_TAG(VM_MEMORY_OBJC_DISPATCHERS), 0);
+                              MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (codeAddr == MAP_FAILED) {
+            _objc_fatal("could not allocate %zu bytes for vtable "
+                        "trampolines (errno %d)", codeSize, errno);
+        }
         uint8_t *t = (uint8_t *)codeAddr;
         
         // Trampoline header
@@ -529,7 +699,7 @@ static void initVtables(void)
         }
 
         appendTrampolines(thdr);
-        sys_icache_invalidate(codeAddr, codeSize);
+        __builtin___clear_cache((char *)codeAddr, (char *)codeAddr + codeSize);
         mprotect(codeAddr, codeSize, PROT_READ|PROT_EXEC);
     }
 
@@ -564,6 +734,10 @@ static void initVtables(void)
             vtableStrlen += strlen(sel_getName(vtableSelectors[i]));
         }
     }
+
+#ifdef OBJC_INSTRUMENTED
+    if (PrintVtables) atexit(printVtableStatistics);
+#endif
 }
 
 
@@ -957,8 +1131,9 @@ static void addUnattachedCategoryForClass(category_t *cat, class_t *cls,
     list = NXMapGet(cats, cls);
     if (!list) {
         list = _calloc_internal(sizeof(*list) + sizeof(list->list[0]), 1);
-    } else {
-        list = _realloc_internal(list, sizeof(*list) + sizeof(list->list[0]) * (list->count + 1));
+    } else if ((list->count & (list->count - 1)) == 0) {
+        // count is a power of two: the list is full, double it
+        list = _realloc_internal(list, sizeof(*list) + sizeof(list->list[0]) * list->count * 2);
     }
     list->list[list->count++] = (category_pair_t){cat, catFromBundle};
     NXMapInsert(cats, cls, list);
@@ -1020,6 +1195,39 @@ static BOOL isRealized(class_t *cls)
 }
 
 
+/***********************************************************************
+* isRealizedComplete
+* Returns YES if class cls has been realized and realizeClass has 
+* finished with it. RW_REALIZED alone is set at the start of realizeClass, 
+* so callers that don't hold runtimeLock must use this instead.
+* Locking: none
+**********************************************************************/
+static BOOL isRealizedComplete(class_t *cls)
+{
+    uint32_t flags = cls->data->flags;
+    if ((flags & (RW_REALIZED|RW_REALIZED_COMPLETE)) != 
+        (RW_REALIZED|RW_REALIZED_COMPLETE)) 
+    {
+        return NO;
+    }
+    OSMemoryBarrier();  // pairs with the barrier in realizeClass
+    return YES;
+}
+
+
+/***********************************************************************
+* isMethodized
+* Returns YES if class cls has been realized and its method, property 
+* and protocol lists have been built. A methodized class's superclasses 
+* are always methodized too.
+* Locking: To prevent concurrent methodization, hold runtimeLock.
+**********************************************************************/
+static BOOL isMethodized(class_t *cls)
+{
+    return isRealized(cls)  &&  (cls->data->flags & RW_METHODIZED) ? YES : NO;
+}
+
+
 /***********************************************************************
 * isFuture
 * Returns YES if class cls is an unrealized future class.
@@ -1115,6 +1323,107 @@ fixupMethodList(method_list_t *mlist, BOOL bundleCopy)
     setMethodListFixedUp(mlist);
 }
 
+// Method list fixup statistics (OBJC_PRINT_METHOD_FIXUPS)
+static size_t methodListsFixedInPlace;
+static size_t methodListBytesFixedInPlace;
+static size_t methodListsCopied;
+static size_t methodListBytesCopied;
+static size_t relroPagesMadeWritable;
+
+/***********************************************************************
+* printMethodFixupStatistics
+* Reports how many method list bytes were fixed up in place instead of 
+* being copied. Registered with atexit() by _read_images() when 
+* OBJC_PRINT_METHOD_FIXUPS is set.
+**********************************************************************/
+static void printMethodFixupStatistics(void)
+{
+    _objc_inform("METHOD FIXUPS: %zu lists (%zu bytes) fixed up in place, "
+                 "%zu lists (%zu bytes) copied, "
+                 "%zu RELRO pages left writable", 
+                 methodListsFixedInPlace, methodListBytesFixedInPlace, 
+                 methodListsCopied, methodListBytesCopied, 
+                 relroPagesMadeWritable);
+}
+
+
+/***********************************************************************
+* fixupMethodListInPlace
+* Fixes up a method list where it lives in its image. Pages the loader 
+* made read-only after relocation (RELRO) are made writable for good: 
+* method_setImplementation and method_exchangeImplementations write 
+* into attached lists later. The pages are already dirty, so this costs 
+* nothing compared to a heap copy. Returns NO if the list is not inside 
+* a known image or its pages can't be written, in which case the 
+* caller copies.
+* Locking: runtimeLock must be held for writing by the caller.
+**********************************************************************/
+static BOOL 
+fixupMethodListInPlace(method_list_t *mlist, BOOL bundleCopy)
+{
+    rwlock_assert_writing(&runtimeLock);
+
+    size_t size = method_list_size(mlist);
+    header_info *hi = _headerForAddress(mlist);
+    if (!hi) return NO;
+
+    int prot = dyld_image_protection(hi->mhdr, mlist, (uint32_t)size);
+    if (prot < 0  ||  (prot & PROT_EXEC)) return NO;
+
+    if (prot & PROT_WRITE) {
+        fixupMethodList(mlist, bundleCopy);
+    } else {
+        // Pages unprotected by the previous call aren't counted twice.
+        static uintptr_t lastStart, lastEnd;
+        uintptr_t pageSize = getpagesize();
+        uintptr_t start = (uintptr_t)mlist & ~(pageSize - 1);
+        uintptr_t end = ((uintptr_t)mlist + size + pageSize - 1) & ~(pageSize - 1);
+        if (start < lastStart  ||  start >= lastEnd  ||  end > lastEnd) {
+            if (mprotect((void *)start, end - start, prot | PROT_WRITE) != 0) {
+                return NO;
+            }
+            if (start >= lastStart  &&  start < lastEnd) {
+                relroPagesMadeWritable += (end - lastEnd) / pageSize;
+            } else {
+                relroPagesMadeWritable += (end - start) / pageSize;
+            }
+            if (PrintMethodFixups) {
+                _objc_inform("METHOD FIXUPS: left RELRO pages %p..%p "
+                             "writable in %s", (void *)start, (void *)end, 
+                             _nameForHeader(hi->mhdr));
+            }
+            lastStart = start;
+            lastEnd = end;
+        }
+        fixupMethodList(mlist, bundleCopy);
+    }
+
+    methodListsFixedInPlace++;
+    methodListBytesFixedInPlace += size;
+    return YES;
+}
+
+
+/***********************************************************************
+* fixupMethodListIfNeeded
+* Returns mlist with its selectors fixed up: the list itself if it was 
+* already fixed up or could be fixed up in place, otherwise a heap copy.
+* Locking: runtimeLock must be held for writing by the caller.
+**********************************************************************/
+static method_list_t *
+fixupMethodListIfNeeded(method_list_t *mlist, BOOL bundleCopy)
+{
+    if (isMethodListFixedUp(mlist)) return mlist;
+    if (fixupMethodListInPlace(mlist, bundleCopy)) return mlist;
+
+    size_t size = method_list_size(mlist);
+    mlist = _memdup_internal(mlist, size);
+    fixupMethodList(mlist, bundleCopy);
+    methodListsCopied++;
+    methodListBytesCopied += size;
+    return mlist;
+}
+
 static void 
 attachMethodLists(class_t *cls, method_list_t **lists, int count, 
                   BOOL methodsFromBundle, BOOL *outVtablesAffected)
@@ -1122,48 +1431,80 @@ attachMethodLists(class_t *cls, method_list_t **lists, int count,
     rwlock_assert_writing(&runtimeLock);
 
     BOOL vtablesAffected = NO;
-    size_t listsSize = count * sizeof(*lists);
+    BOOL rrAffected = NO;
+    uint32_t weakHooks = 0;
+    class_rw_t *rw = cls->data;
+    uint32_t oldCount = rw->methodListCount;
+    uint32_t addCount = 0;
+    int i;
 
-    // Create or extend method list array
-    // Leave `count` empty slots at the start of the array to be filled below.
+    for (i = 0; i < count; i++) {
+        if (lists[i]) addCount++;
+    }
+    if (addCount == 0) {
+        if (outVtablesAffected) *outVtablesAffected = NO;
+        return;
+    }
+
+    // Create or extend method list array. Capacity doubles, so a class 
+    // that keeps getting categories reallocates only O(log n) times.
+    if (oldCount + addCount + 1 > rw->methodListCapacity) {
+        uint32_t capacity = rw->methodListCapacity ? rw->methodListCapacity : 4;
+        while (capacity < oldCount + addCount + 1) capacity *= 2;
+        rw->methods = (method_list_t **)
+            _realloc_internal(rw->methods, capacity * sizeof(*lists));
+        rw->methodListCapacity = capacity;
+    }
 
-    if (!cls->data->methods) {
-        // no bonus method lists yet
-        cls->data->methods = _calloc_internal(1 + count, sizeof(*lists));
+    // Leave `addCount` empty slots at the start of the array to be 
+    // filled below.
+    if (oldCount) {
+        memmove(rw->methods + addCount, rw->methods, 
+                (oldCount + 1) * sizeof(*lists));
     } else {
-        size_t oldSize = malloc_size(cls->data->methods);
-        cls->data->methods = 
-            _realloc_internal(cls->data->methods, oldSize + listsSize);
-        memmove(cls->data->methods + count, cls->data->methods, oldSize);
+        rw->methods[addCount] = NULL;
     }
+    rw->methodListCount = oldCount + addCount;
 
     // Add method lists to array.
-    // Reallocate un-fixed method lists.
+    // Fix up un-fixed method lists, in place if possible.
 
-    int i;
+    uint32_t slot = 0;
     for (i = 0; i < count; i++) {
         method_list_t *mlist = lists[i];
         if (!mlist) continue;
 
         // Fixup selectors if necessary
-        if (!isMethodListFixedUp(mlist)) {
-            mlist = _memdup_internal(mlist, method_list_size(mlist));
-            fixupMethodList(mlist, methodsFromBundle);
-        }
+        mlist = fixupMethodListIfNeeded(mlist, methodsFromBundle);
 
-        // Scan for vtable updates
-        if (outVtablesAffected  &&  !vtablesAffected) {
+        // Scan for vtable updates, retain/release overrides 
+        // and weak reference hooks
+        if ((outVtablesAffected  &&  !vtablesAffected)  ||  
+            !rrAffected  ||  weakHooks != RW_WEAK_REFERENCE_HOOKS) 
+        {
             uint32_t m;
             for (m = 0; m < mlist->count; m++) {
                 SEL sel = method_list_nth(mlist, m)->name;
                 if (vtable_containsSelector(sel)) vtablesAffected = YES;
+                if (isRRSelector(sel)) rrAffected = YES;
+                if (sel == SEL_allowsWeakReference) {
+                    weakHooks |= RW_HAS_ALLOWS_WEAK_REFERENCE;
+                } else if (sel == SEL_retainWeakReference) {
+                    weakHooks |= RW_HAS_RETAIN_WEAK_REFERENCE;
+                }
             }
         }
         
         // Fill method list array
-        cls->data->methods[i] = mlist;
+        rw->methods[slot++] = mlist;
     }
 
+    // New methods may override the root retain/release. 
+    // methodizeClass computes the flag from scratch afterwards.
+    if (rrAffected  &&  (rw->flags & RW_HAS_DEFAULT_RR)) clearDefaultRR(cls);
+
+    if (weakHooks & ~rw->flags) addWeakReferenceHooks(cls, weakHooks);
+
     if (outVtablesAffected) *outVtablesAffected = vtablesAffected;
 }
 
@@ -1336,6 +1677,13 @@ static void methodizeClass(struct class_t *cls)
                      getName(cls), isMeta ? "(meta)" : "");
     }
     
+    // Weak reference hooks are inherited; the superclass is methodized.
+    if (getSuperclass(cls)) {
+        uint32_t hooks = 
+            getSuperclass(cls)->data->flags & RW_WEAK_REFERENCE_HOOKS;
+        if (hooks) changeInfo(cls, hooks, 0);
+    }
+
     // Build method and protocol and property lists.
     // Include methods and protocols and properties from categories, if any
     // Do NOT use cat->cls! It may have been remapped.
@@ -1369,8 +1717,51 @@ static void methodizeClass(struct class_t *cls)
     
     if (cats) _free_internal(cats);
 
-    // No vtable until +initialize completes
-    assert(cls->vtable == _objc_empty_vtable);
+    if (classHasDefaultRR(cls)) changeInfo(cls, RW_HAS_DEFAULT_RR, 0);
+    changeInfo(cls, RW_METHODIZED, 0);
+
+    // No vtable until +initialize completes. A class that completed 
+    // +initialize before it was methodized gets its vtable now.
+    if (_class_isInitialized((Class)cls)) {
+        flushVtables(cls);
+    } else {
+        assert(cls->vtable == _objc_empty_vtable);
+    }
+}
+
+
+/***********************************************************************
+* methodizeClassIfNeeded
+* Methodizes cls and any superclasses left unmethodized by 
+* OBJC_LAZY_METHODIZATION, superclasses first.
+* Locking: runtimeLock must be write-locked by the caller
+**********************************************************************/
+static void methodizeClassIfNeeded(class_t *cls)
+{
+    rwlock_assert_writing(&runtimeLock);
+
+    if (!cls  ||  isMethodized(cls)) return;
+
+    realizeClass(cls);
+    methodizeClassIfNeeded(getSuperclass(cls));
+    methodizeClass(cls);
+}
+
+
+/***********************************************************************
+* prepareForMethodQuery
+* Makes sure cls can be searched for methods, properties and protocols.
+* Only does work for classes left unmethodized by OBJC_LAZY_METHODIZATION.
+* Locking: runtimeLock must not be held by the caller; 
+*   write-locks runtimeLock if cls is not methodized yet
+**********************************************************************/
+static void prepareForMethodQuery(class_t *cls)
+{
+    if (!cls  ||  isMethodized(cls)) return;
+
+    rwlock_write(&runtimeLock);
+    methodizeClassIfNeeded(cls);
+    rwlock_unlock_write(&runtimeLock);
 }
 
 
@@ -1452,12 +1843,20 @@ static void changeInfo(class_t *cls, unsigned int set, unsigned int clear)
 
 NXMapTable *gdb_objc_realized_classes;  // exported for debuggers in objc-gdb.h
 
+// Initial capacity for a table: the size seen at the end of the 
+// previous launch (from the launch cache), but at least minimum.
+static unsigned tableCapacity(unsigned minimum, uint32_t previous)
+{
+    return previous > minimum ? previous : minimum;
+}
+
 static NXMapTable *namedClasses(void)
 {
     rwlock_assert_locked(&runtimeLock);
 
     INIT_ONCE_PTR(gdb_objc_realized_classes, 
-                  NXCreateMapTableFromZone(NXStrValueMapPrototype, 1024, 
+                  NXCreateMapTableFromZone(NXStrValueMapPrototype, 
+                                           tableCapacity(1024, launch_cache_classCount()), 
                                            _objc_internal_zone()), 
                   NXFreeMapTable(v) );
 
@@ -1465,6 +1864,162 @@ static NXMapTable *namedClasses(void)
 }
 
 
+/***********************************************************************
+* _objc_namedClassCount
+* Number of classes in namedClasses. For the launch cache.
+* Locking: runtimeLock must be held by the caller
+**********************************************************************/
+__private_extern__ uint32_t _objc_namedClassCount(void)
+{
+    return NXCountMapTable(namedClasses());
+}
+
+
+/***********************************************************************
+* Lock-free class name table
+* Mirrors namedClasses() for objc_getClass and objc_lookUpClass, which 
+* probe it without taking runtimeLock. Writers hold runtimeLock.
+*
+* Slots point to immutable entries that carry the name's hash. A slot 
+* goes from NULL to an entry (published after a barrier), and from an 
+* entry to classNameTombstone when the class is removed; it never goes 
+* back. Readers depend on the slot pointer to see a complete entry.
+* When the table grows, the new table is filled and published before 
+* the old one is retired. Retired tables and removed entries are never 
+* freed because readers don't announce themselves. 
+* Inserts reuse tombstones in place, and a grow happens only after a 
+* quarter of the table's slots went from NULL to an entry, so under 
+* add/remove churn (dlclose, objc_disposeClassPair) the leak is one 
+* entry per removed class plus at most four slot pointers per add.
+**********************************************************************/
+typedef struct {
+    uint32_t hash;
+    const char *name;
+    class_t *cls;
+} class_name_entry;
+
+typedef struct {
+    uint32_t mask;      // capacity - 1
+    uint32_t used;      // entries and tombstones
+    class_name_entry * volatile slots[0];
+} class_name_table;
+
+static class_name_entry classNameTombstone = { 0, "", NULL };
+static class_name_table * volatile classNameTable = NULL;
+
+static class_name_table *newClassNameTable(uint32_t capacity)
+{
+    class_name_table *table = (class_name_table *)
+        _calloc_internal(sizeof(class_name_table) + 
+                         capacity * sizeof(class_name_entry *), 1);
+    table->mask = capacity - 1;
+    table->used = 0;
+    return table;
+}
+
+static void insertClassNameEntry(class_name_table *table, 
+                                 class_name_entry *entry)
+{
+    uint32_t index = entry->hash & table->mask;
+    class_name_entry *slot;
+    while ((slot = table->slots[index])  &&  slot != &classNameTombstone) {
+        index = (index + 1) & table->mask;
+    }
+    if (!slot) table->used++;
+    OSMemoryBarrier();  // entry contents before the slot
+    table->slots[index] = entry;
+}
+
+static void addClassName(class_t *cls, const char *name)
+{
+    class_name_table *table = classNameTable;
+    class_name_entry *entry;
+
+    rwlock_assert_writing(&runtimeLock);
+
+    if (!table  ||  (table->used + 1) * 4 > (table->mask + 1) * 3) {
+        // Grow (dropping tombstones), then publish the new table.
+        uint32_t capacity = 256;
+        uint32_t live = 0;
+        uint32_t i;
+        if (table) {
+            for (i = 0; i <= table->mask; i++) {
+                entry = table->slots[i];
+                if (entry  &&  entry != &classNameTombstone) live++;
+            }
+        }
+        while ((live + 1) * 2 > capacity) capacity *= 2;
+        class_name_table *newTable = newClassNameTable(capacity);
+        if (table) {
+            for (i = 0; i <= table->mask; i++) {
+                entry = table->slots[i];
+                if (entry  &&  entry != &classNameTombstone) {
+                    insertClassNameEntry(newTable, entry);
+                }
+            }
+        }
+        OSMemoryBarrier();
+        classNameTable = table = newTable;
+    }
+
+    entry = (class_name_entry *)_malloc_internal(sizeof(class_name_entry));
+    entry->hash = _objc_strhash(name);
+    entry->name = name;
+    entry->cls = cls;
+    insertClassNameEntry(table, entry);
+}
+
+static void removeClassName(class_t *cls, const char *name)
+{
+    class_name_table *table = classNameTable;
+    uint32_t hash, index;
+    class_name_entry *entry;
+
+    rwlock_assert_writing(&runtimeLock);
+
+    if (!table) return;
+    hash = _objc_strhash(name);
+    for (index = hash & table->mask; 
+         (entry = table->slots[index]); 
+         index = (index + 1) & table->mask) 
+    {
+        if (entry->cls == cls) {
+            table->slots[index] = &classNameTombstone;
+            return;
+        }
+    }
+}
+
+
+/***********************************************************************
+* getClassNoLock
+* Looks up a class by name in the lock-free class name table. 
+* The class MIGHT NOT be realized, or might be in the middle of 
+* realizeClass on another thread; check isRealizedComplete.
+* Locking: none
+**********************************************************************/
+static class_t *getClassNoLock(const char *name)
+{
+    class_name_table *table = classNameTable;
+    class_name_entry *entry;
+    uint32_t hash, index;
+
+    if (!table) return NULL;
+    hash = _objc_strhash(name);
+    for (index = hash & table->mask; 
+         (entry = table->slots[index]); 
+         index = (index + 1) & table->mask) 
+    {
+        if (entry->hash == hash  &&  entry->cls  &&  
+            0 == strcmp(entry->name, name)) 
+        {
+            return entry->cls;
+        }
+    }
+    return NULL;
+}
+
+
 /***********************************************************************
 * addNamedClass
 * Adds name => cls to the named non-meta class map.
@@ -1479,6 +2034,7 @@ static void addNamedClass(class_t *cls, const char *name)
         inform_duplicate(name, (Class)old, (Class)cls);
     } else {
         NXMapInsert(namedClasses(), name, cls);
+        addClassName(cls, name);
     }
     assert(!(cls->data->flags & RO_META));
 
@@ -1498,6 +2054,7 @@ static void removeNamedClass(class_t *cls, const char *name)
     assert(!(cls->data->flags & RO_META));
     if (cls == NXMapGet(namedClasses(), name)) {
         NXMapRemove(namedClasses(), name);
+        removeClassName(cls, name);
     } else {
         // cls has a name collision with another class - don't remove the other
     }
@@ -1879,7 +2436,8 @@ static NXMapTable *protocols(void)
     rwlock_assert_locked(&runtimeLock);
 
     INIT_ONCE_PTR(protocol_map, 
-                  NXCreateMapTableFromZone(NXStrValueMapPrototype, 16, 
+                  NXCreateMapTableFromZone(NXStrValueMapPrototype, 
+                                           tableCapacity(16, launch_cache_protocolCount()), 
                                            _objc_internal_zone()), 
                   NXFreeMapTable(v) );
 
@@ -1887,6 +2445,17 @@ static NXMapTable *protocols(void)
 }
 
 
+/***********************************************************************
+* _objc_protocolCount
+* Number of registered protocols. For the launch cache.
+* Locking: runtimeLock must be held by the caller
+**********************************************************************/
+__private_extern__ uint32_t _objc_protocolCount(void)
+{
+    return NXCountMapTable(protocols());
+}
+
+
 /***********************************************************************
 * remapProtocol
 * Returns the live protocol pointer for proto, which may be pointing to 
@@ -2124,7 +2693,11 @@ static class_t *realizeClass(class_t *cls)
     }
 
     // Attach categories
-    methodizeClass(cls);
+    // With OBJC_LAZY_METHODIZATION this waits until the class is 
+    // first searched for a method (see methodizeClassIfNeeded).
+    if (!LazyMethodization) {
+        methodizeClass(cls);
+    }
 
     if (!isMeta) {
         addRealizedClass(cls);
@@ -2132,6 +2705,10 @@ static class_t *realizeClass(class_t *cls)
         addRealizedMetaclass(cls);
     }
 
+    // Publish for lock-free readers (look_up_class). 
+    // changeInfo's barrier orders everything above before the flag.
+    changeInfo(cls, RW_REALIZED_COMPLETE, 0);
+
     return cls;
 }
 
@@ -2189,6 +2766,196 @@ static void realizeAllClasses(void)
 }
 
 
+/***********************************************************************
+* methodizeAllClasses
+* Realizes all classes in all known images and attaches their pending 
+* categories, so later queries never have to write class metadata.
+* Returns the number of classes.
+* Locking: runtimeLock must be write-locked by the caller.
+**********************************************************************/
+static unsigned int methodizeAllClasses(void)
+{
+    NXHashTable *classes;
+    NXHashState state;
+    class_t *cls;
+
+    rwlock_assert_writing(&runtimeLock);
+
+    realizeAllClasses();
+
+    classes = realizedClasses();
+    state = NXInitHashState(classes);
+    while (NXNextHashState(classes, &state, (void **)&cls)) {
+        methodizeClassIfNeeded(cls);
+        methodizeClassIfNeeded(cls->isa);
+    }
+
+    return NXCountHashTable(classes);
+}
+
+
+/***********************************************************************
+* objc_freezeRuntime
+* Makes class metadata immutable so readers can skip runtimeLock and 
+* selLock. All classes are realized and methodized first, so a frozen 
+* lookup never has to modify anything.
+* Locking: write-locks runtimeLock
+**********************************************************************/
+void objc_freezeRuntime(void)
+{
+    rwlock_write(&runtimeLock);
+
+    if (!RuntimeFrozen) {
+        unsigned int count = methodizeAllClasses();
+
+        // Readers that see the flag must see everything written above.
+        OSMemoryBarrier();
+        RuntimeFrozen = YES;
+
+        if (PrintConnecting) {
+            _objc_inform("CLASS: runtime frozen with %u realized classes", 
+                         count);
+        }
+    }
+
+    rwlock_unlock_write(&runtimeLock);
+}
+
+
+/***********************************************************************
+* objc_unfreezeRuntime
+* Allows class metadata to change again. The caller must make sure no 
+* other thread is inside the runtime: frozen readers hold no lock.
+* Locking: write-locks runtimeLock
+**********************************************************************/
+void objc_unfreezeRuntime(void)
+{
+    rwlock_write(&runtimeLock);
+    RuntimeFrozen = NO;
+    OSMemoryBarrier();
+    rwlock_unlock_write(&runtimeLock);
+}
+
+
+BOOL objc_isRuntimeFrozen(void)
+{
+    return RuntimeFrozen;
+}
+
+
+/***********************************************************************
+* fillForkCaches
+* Fills the method caches of initialized classes and metaclasses with 
+* the OBJC_FORK_SELECTORS selectors they implement. Caches grow as 
+* needed, so each ends up sized for its hot selectors.
+* Locking: acquires runtimeLock and cacheUpdateLock
+**********************************************************************/
+static void fillForkCaches(Class *classes, int count)
+{
+    const char **names;
+    size_t nameCount, i;
+    SEL *sels;
+    size_t fills = 0;
+    int c;
+
+    if (!ForkSelectorsFile) {
+        _objc_inform("FORK: OBJC_FORK_SELECTORS is not set; "
+                     "method caches not filled");
+        return;
+    }
+
+    names = loadSelectorProfile(ForkSelectorsFile, (size_t)-1, 
+                                "FORK", &nameCount);
+    if (!names) return;
+
+    sels = _malloc_internal(nameCount * sizeof(SEL));
+    for (i = 0; i < nameCount; i++) {
+        sels[i] = sel_registerName(names[i]);
+        _free_internal((void *)names[i]);
+    }
+    _free_internal(names);
+
+    for (c = 0; c < count; c++) {
+        Class targets[2] = { classes[c], _class_getMeta(classes[c]) };
+        int t;
+
+        // Caches are never filled before +initialize completes.
+        if (!_class_isInitialized(classes[c])) continue;
+
+        for (t = 0; t < 2; t++) {
+            for (i = 0; i < nameCount; i++) {
+                Method m = _class_getMethod(targets[t], sels[i]);
+                if (m  &&  _cache_fill(targets[t], m, sels[i])) fills++;
+            }
+        }
+    }
+
+    _free_internal(sels);
+
+    if (PrintCaches) {
+        _objc_inform("FORK: %zu cache entries for %zu selectors from %s", 
+                     fills, nameCount, ForkSelectorsFile);
+    }
+}
+
+
+/***********************************************************************
+* objc_prepareForFork
+* Does the metadata writes that children of a prefork server would 
+* otherwise each do on their own copy-on-write pages: realizes all 
+* classes and attaches their categories, and optionally sends 
+* +initialize and fills method caches.
+* Locking: acquires runtimeLock; +initialize runs with no lock held
+**********************************************************************/
+void objc_prepareForFork(unsigned int flags)
+{
+    Class *classes;
+    int count, i;
+
+    rwlock_write(&runtimeLock);
+    methodizeAllClasses();
+    rwlock_unlock_write(&runtimeLock);
+
+    if (!(flags & (OBJC_FORK_INITIALIZE | OBJC_FORK_FILL_CACHES))) return;
+
+    count = objc_getClassList(NULL, 0);
+    classes = _malloc_internal(count * sizeof(Class));
+    i = objc_getClassList(classes, count);
+    if (i < count) count = i;
+
+    if (flags & OBJC_FORK_INITIALIZE) {
+        for (i = 0; i < count; i++) {
+            if (!_class_isInitialized(classes[i])) {
+                _class_initialize(classes[i]);
+            }
+        }
+    }
+
+    if (flags & OBJC_FORK_FILL_CACHES) {
+        fillForkCaches(classes, count);
+    }
+
+    _free_internal(classes);
+}
+
+
+/***********************************************************************
+* rejectIfFrozen
+* Returns YES, after logging, if the runtime is frozen. The caller must 
+* then fail without modifying any class metadata.
+* Locking: runtimeLock must be held for writing by the caller.
+**********************************************************************/
+static BOOL rejectIfFrozen(const char *function)
+{
+    rwlock_assert_writing(&runtimeLock);
+
+    if (!RuntimeFrozen) return NO;
+    _objc_inform("*** %s: the runtime is frozen; "
+                 "call objc_unfreezeRuntime() first", function);
+    return YES;
+}
+
+
 /***********************************************************************
 * _objc_allocateFutureClass
 * Allocate an unresolved future class for the given class name.
@@ -2231,6 +2998,65 @@ void objc_setFutureClass(Class cls, const char *name)
 }
 
 
+/***********************************************************************
+* _objc_insert_tagged_isa
+* Registers cls as the class of tagged pointers in slot slotNumber.
+* objc_msgSend reads this table without locks, so cls is realized 
+* before it is published and a slot can't be changed once set.
+* Locking: acquires runtimeLock
+**********************************************************************/
+__private_extern__ Class _objc_tagged_isa_table[_OBJC_TAG_SLOT_COUNT];
+
+void _objc_insert_tagged_isa(unsigned char slotNumber, Class isa)
+{
+    class_t *cls = newcls(isa);
+
+    if (slotNumber >= _OBJC_TAG_SLOT_COUNT) {
+        _objc_fatal("tagged pointer slot %u out of range (max %u)", 
+                    slotNumber, _OBJC_TAG_SLOT_COUNT - 1);
+    }
+    if (!cls) {
+        _objc_fatal("tagged pointer slot %u: class is nil", slotNumber);
+    }
+
+    rwlock_write(&runtimeLock);
+
+    if (_objc_tagged_isa_table[slotNumber]  &&  
+        _objc_tagged_isa_table[slotNumber] != isa) 
+    {
+        _objc_fatal("tagged pointer slot %u is already taken by class %s", 
+                    slotNumber, 
+                    getName(newcls(_objc_tagged_isa_table[slotNumber])));
+    }
+
+    realizeClass(cls);
+    methodizeClassIfNeeded(cls);
+    OSMemoryBarrier();
+    _objc_tagged_isa_table[slotNumber] = isa;
+
+    if (PrintConnecting) {
+        _objc_inform("CLASS: class '%s' registered for tagged pointer "
+                     "slot %u", getName(cls), slotNumber);
+    }
+
+    rwlock_unlock_write(&runtimeLock);
+}
+
+
+/***********************************************************************
+* _objc_taggedPointerSlotError
+* Called by the messengers (GetIsa in objc-msg-arm.S) instead of 
+* searching a Nil class when a message is sent to a tagged pointer 
+* whose slot has no class registered.
+* Locking: none
+**********************************************************************/
+__private_extern__ void _objc_taggedPointerSlotError(unsigned slot)
+{
+    _objc_fatal("message sent to a tagged pointer in slot %u, "
+                "which has no class registered", slot);
+}
+
+
 #define FOREACH_REALIZED_SUBCLASS(_c, _cls, code)                       \
     do {                                                                \
         rwlock_assert_writing(&runtimeLock);                                \
@@ -2283,24 +3109,122 @@ static void flushVtables(class_t *cls)
     }
 
     FOREACH_REALIZED_SUBCLASS(c, cls, {
-        updateVtable(c, NO);
+        updateVtable(c, NO);
+    });
+}
+
+
+/***********************************************************************
+* flushCaches
+* Flushes caches for cls and its realized subclasses.
+* Does not update vtables.
+* If cls is Nil, all realized and metaclasses classes are touched.
+* Locking: runtimeLock must be held by the caller.
+**********************************************************************/
+static void flushCaches(class_t *cls)
+{
+    rwlock_assert_writing(&runtimeLock);
+
+    FOREACH_REALIZED_SUBCLASS(c, cls, {
+        flush_cache((Class)c);
+    });
+}
+
+
+/***********************************************************************
+* isRRSelector
+* Returns YES if sel is one of the selectors objc_retain and friends 
+* bypass when a class uses the root implementations.
+* Locking: none
+**********************************************************************/
+static BOOL isRRSelector(SEL sel)
+{
+    return (sel == SEL_retain  ||  sel == SEL_release  ||  
+            sel == SEL_autorelease  ||  sel == SEL_retainCount);
+}
+
+
+/***********************************************************************
+* classHasDefaultRR
+* Returns YES if instances of cls can be retained and released with 
+* the root implementations directly (see objc_retain).
+* A root class opts in by implementing -retain, -release, -autorelease 
+* and -retainCount with _objc_rootRetain and friends. A subclass 
+* qualifies if its superclass does and it doesn't override any of them.
+* Metaclasses never qualify; class objects are not reference counted.
+* Locking: runtimeLock must be held by the caller.
+**********************************************************************/
+static BOOL classHasDefaultRR(class_t *cls)
+{
+    class_t *supercls;
+    unsigned int found = 0;
+    uint32_t i;
+
+    rwlock_assert_writing(&runtimeLock);
+
+    if (isMetaClass(cls)) return NO;
+
+    supercls = getSuperclass(cls);
+    if (supercls  &&  !(supercls->data->flags & RW_HAS_DEFAULT_RR)) return NO;
+
+    FOREACH_METHOD_LIST(mlist, cls, {
+        for (i = 0; i < mlist->count; i++) {
+            method_t *m = method_list_nth(mlist, i);
+            IMP imp = _method_getImplementation(m);
+            if (m->name == SEL_retain) {
+                if (imp != (IMP)&_objc_rootRetain) return NO;
+                found |= 1;
+            } else if (m->name == SEL_release) {
+                if (imp != (IMP)&_objc_rootRelease) return NO;
+                found |= 2;
+            } else if (m->name == SEL_autorelease) {
+                if (imp != (IMP)&_objc_rootAutorelease) return NO;
+                found |= 4;
+            } else if (m->name == SEL_retainCount) {
+                if (imp != (IMP)&_objc_rootRetainCount) return NO;
+                found |= 8;
+            }
+        }
+    });
+
+    return (supercls  ||  found == 15) ? YES : NO;
+}
+
+
+/***********************************************************************
+* clearDefaultRR
+* Sends objc_retain and friends back to message dispatch for cls 
+* and its realized subclasses. The flag is not recomputed; a class 
+* whose retain/release was changed at runtime stays on the slow path.
+* If cls is Nil, all realized classes are touched.
+* Locking: runtimeLock must be held by the caller.
+**********************************************************************/
+static void clearDefaultRR(class_t *cls)
+{
+    rwlock_assert_writing(&runtimeLock);
+
+    FOREACH_REALIZED_SUBCLASS(c, cls, {
+        if (c->data->flags & RW_HAS_DEFAULT_RR) {
+            changeInfo(c, 0, RW_HAS_DEFAULT_RR);
+        }
     });
 }
 
 
 /***********************************************************************
-* flushCaches
-* Flushes caches for cls and its realized subclasses.
-* Does not update vtables.
-* If cls is Nil, all realized and metaclasses classes are touched.
+* addWeakReferenceHooks
+* Records that cls gained -allowsWeakReference and/or 
+* -retainWeakReference (RW_HAS_ALLOWS_WEAK_REFERENCE and 
+* RW_HAS_RETAIN_WEAK_REFERENCE in hooks), for it and its realized 
+* subclasses. Methods are never removed, so the flags are never cleared.
 * Locking: runtimeLock must be held by the caller.
 **********************************************************************/
-static void flushCaches(class_t *cls)
+static void addWeakReferenceHooks(class_t *cls, uint32_t hooks)
 {
     rwlock_assert_writing(&runtimeLock);
 
     FOREACH_REALIZED_SUBCLASS(c, cls, {
-        flush_cache((Class)c);
+        if (hooks & ~c->data->flags) changeInfo(c, hooks, 0);
     });
 }
 
@@ -2399,6 +3323,60 @@ unmap_image(const struct mach_header *mh, intptr_t vmaddr_slide)
 }
 
 
+/***********************************************************************
+* lookupSelrefs
+* Worker for _read_images' selector fixup. For selrefs [begin, end) 
+* of the batch, replaces names that are already registered with their 
+* selectors and records the hash of the others for the serial insert.
+* Runs on worker threads while _read_images holds selLock.
+* Locking: none (selLock held by _read_images on the calling thread)
+**********************************************************************/
+// Below this many selrefs per thread, threads cost more than they save.
+#define SELREF_MIN_PER_THREAD 2048
+
+typedef struct {
+    const header_info *hi;
+    SEL *sels;
+    size_t count;
+    size_t start;      // index of sels[0] in the batch
+    BOOL isBundle;
+} selref_image;
+
+typedef struct {
+    selref_image *images;
+    uint32_t imageCount;
+    size_t total;
+    uint32_t *hashes;  // per selref: hash of the name if not resolved
+    uint8_t *resolved; // per selref: YES if sels[i] is now a real selector
+} selref_batch;
+
+static void lookupSelrefs(void *context, size_t begin, size_t end)
+{
+    selref_batch *batch = (selref_batch *)context;
+    uint32_t imageIndex;
+
+    for (imageIndex = 0; imageIndex < batch->imageCount; imageIndex++) {
+        selref_image *image = &batch->images[imageIndex];
+        size_t first = image->start;
+        size_t last = image->start + image->count;
+        size_t n;
+
+        if (last <= begin) continue;
+        if (first >= end) break;
+        if (first < begin) first = begin;
+        if (last > end) last = end;
+
+        for (n = first; n < last; n++) {
+            SEL *ref = &image->sels[n - image->start];
+            SEL sel = sel_lookupNameNoLock((const char *)*ref, 
+                                           &batch->hashes[n]);
+            if (sel) *ref = sel;
+            batch->resolved[n] = sel ? YES : NO;
+        }
+    }
+}
+
+
 /***********************************************************************
 * _read_images
 * Perform initial processing of the headers in the linked 
@@ -2417,11 +3395,22 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
     class_t **resolvedFutureClasses = NULL;
     size_t resolvedFutureClassCount = 0;
     static BOOL doneOnce;
+    BOOL timing = StartupTimesEnabled;
+    uint64_t phaseStart = 0;
+    uint64_t imageStart = 0;
 
     rwlock_assert_writing(&runtimeLock);
 
+    if (RuntimeFrozen  &&  hCount > 0) {
+        _objc_fatal("image '%s' loaded while the runtime is frozen; "
+                    "call objc_unfreezeRuntime() first", 
+                    _nameForHeader(hList[0]->mhdr));
+    }
+
     if (!doneOnce) {
         initVtables();
+        launch_cache_init();
+        if (PrintMethodFixups) atexit(printMethodFixupStatistics);
         doneOnce = YES;
     }
 
@@ -2430,6 +3419,18 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
     hIndex < hCount && (hi = hList[hIndex]);    \
     hIndex++
 
+    // OBJC_PRINT_STARTUP_TIMES: whole phases, and each image within a phase
+#define PHASE_START \
+    if (timing) phaseStart = _objc_startupTimeNow()
+#define PHASE_END(phase) \
+    if (timing) _objc_logStartupTime(phase, NULL, NULL, \
+                                     _objc_startupTimeNow() - phaseStart)
+#define IMAGE_START \
+    if (timing) imageStart = _objc_startupTimeNow()
+#define IMAGE_END(phase) \
+    if (timing) _objc_logStartupTime(phase, hi, NULL, \
+                                     _objc_startupTimeNow() - imageStart)
+
     // Complain about images that contain old-ABI data
     // fixme new-ABI compiler still emits some bits into __OBJC segment
     for (EACH_HEADER) {
@@ -2456,8 +3457,10 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
     }
 
     // Discover classes. Fix up unresolved future classes. Mark bundle classes.
+    PHASE_START;
     NXMapTable *future_class_map = futureClasses();
     for (EACH_HEADER) {
+        IMAGE_START;
         class_t **classlist = _getObjc2ClassList(hi, &count);
         for (i = 0; i < count; i++) {
             const char *name = getName(classlist[i]);
@@ -2490,6 +3493,7 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
                 classlist[i]->isa->data->flags |= RO_FROM_BUNDLE;
             }
         }
+        IMAGE_END("class discovery");
     }
 
     // Fix up remapped classes
@@ -2508,10 +3512,19 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
             }
         }
     }
+    PHASE_END("class discovery");
 
 
     // Fix up @selector references
+    // Hashing and looking up the names is spread across worker threads; 
+    // only names not yet registered are inserted, serially, afterwards.
+    // Workers span images, so this phase is only timed as a whole.
+    PHASE_START;
     sel_lock();
+    selref_batch selrefs;
+    selrefs.imageCount = 0;
+    selrefs.total = 0;
+    selrefs.images = _malloc_internal(hCount * sizeof(selref_image));
     for (EACH_HEADER) {
         if (PrintPreopt) {
             if (sel_preoptimizationValid(hi)) {
@@ -2526,17 +3539,47 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
         
         if (sel_preoptimizationValid(hi)) continue;
 
-        SEL *sels = _getObjc2SelectorRefs(hi, &count);
-        BOOL isBundle = hi->mhdr->filetype == MH_BUNDLE;
-        for (i = 0; i < count; i++) {
-            sels[i] = sel_registerNameNoLock((const char *)sels[i], isBundle);
+        selref_image *image = &selrefs.images[selrefs.imageCount];
+        image->sels = _getObjc2SelectorRefs(hi, &image->count);
+        if (launch_cache_fixupSelectorRefs(hi, image->sels, image->count)) {
+            continue;
         }
+        image->hi = hi;
+        image->start = selrefs.total;
+        selrefs.imageCount++;
+        image->isBundle = hi->mhdr->filetype == MH_BUNDLE;
+        selrefs.total += image->count;
+    }
+    selrefs.hashes = _malloc_internal(selrefs.total * sizeof(uint32_t));
+    selrefs.resolved = _malloc_internal(selrefs.total);
+
+    _objc_parallel_apply(selrefs.total, SELREF_MIN_PER_THREAD, 
+                         lookupSelrefs, &selrefs);
+
+    for (hIndex = 0; hIndex < selrefs.imageCount; hIndex++) {
+        selref_image *image = &selrefs.images[hIndex];
+        for (i = 0; i < image->count; i++) {
+            size_t n = image->start + i;
+            if (selrefs.resolved[n]) continue;
+            image->sels[i] = 
+                sel_registerNameHashedNoLock((const char *)image->sels[i], 
+                                             selrefs.hashes[n], 
+                                             image->isBundle);
+        }
+        launch_cache_recordSelectorRefs(image->hi, image->sels, image->count);
     }
+
+    _free_internal(selrefs.resolved);
+    _free_internal(selrefs.hashes);
+    _free_internal(selrefs.images);
     sel_unlock();
+    PHASE_END("selector fixup");
 
     // Discover protocols. Fix up protocol refs.
+    PHASE_START;
     NXMapTable *protocol_map = protocols();
     for (EACH_HEADER) {
+        IMAGE_START;
         extern struct class_t OBJC_CLASS_$_Protocol;
         Class cls = (Class)&OBJC_CLASS_$_Protocol;
         assert(cls);
@@ -2558,6 +3601,7 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
                 }
             }
         }
+        IMAGE_END("protocol registration");
     }
     for (EACH_HEADER) {
         protocol_t **protocols;
@@ -2566,14 +3610,18 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
             remapProtocolRef(&protocols[i]);
         }
     }
+    PHASE_END("protocol registration");
 
     // Realize non-lazy classes (for +load methods and static instances)
+    PHASE_START;
     for (EACH_HEADER) {
+        IMAGE_START;
         class_t **classlist = 
             _getObjc2NonlazyClassList(hi, &count);
         for (i = 0; i < count; i++) {
             realizeClass(remapClass(classlist[i]));
         }
+        IMAGE_END("non-lazy realization");
     }    
 
     // Realize newly-resolved future classes, in case CF manipulates them
@@ -2583,9 +3631,17 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
         }
         _free_internal(resolvedFutureClasses);
     }    
+    PHASE_END("non-lazy realization");
 
     // Discover categories. 
+    // Classes that are already methodized get all of this pass's 
+    // categories attached at once, after every image has been scanned.
+    PHASE_START;
+    NXHashTable *remethodize = 
+        NXCreateHashTableFromZone(NXPtrPrototype, 16, NULL, 
+                                  _objc_internal_zone());
     for (EACH_HEADER) {
+        IMAGE_START;
         category_t **catlist = 
             _getObjc2CategoryList(hi, &count);
         for (i = 0; i < count; i++) {
@@ -2602,8 +3658,8 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
                 ||  cat->instanceProperties) 
             {
                 addUnattachedCategoryForClass(cat, cls, hi);
-                if (isRealized(cls)) {
-                    remethodizeClass(cls);
+                if (isMethodized(cls)) {
+                    NXHashInsert(remethodize, cls);
                     classExists = YES;
                 }
                 if (PrintConnecting) {
@@ -2617,8 +3673,8 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
                 /* ||  cat->classProperties */) 
             {
                 addUnattachedCategoryForClass(cat, cls->isa, hi);
-                if (isRealized(cls->isa)) {
-                    remethodizeClass(cls->isa);
+                if (isMethodized(cls->isa)) {
+                    NXHashInsert(remethodize, cls->isa);
                 }
                 if (PrintConnecting) {
                     _objc_inform("CLASS: found category +%s(%s)", 
@@ -2626,7 +3682,17 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
                 }
             }
         }
+        IMAGE_END("category attachment");
+    }
+    {
+        NXHashState state = NXInitHashState(remethodize);
+        class_t *cls;
+        while (NXNextHashState(remethodize, &state, (void **)&cls)) {
+            remethodizeClass(cls);
+        }
+        NXFreeHashTable(remethodize);
     }
+    PHASE_END("category attachment");
 
     // Category discovery MUST BE LAST to avoid potential races 
     // when other threads call the new category code before 
@@ -2634,6 +3700,10 @@ __private_extern__ void _read_images(header_info **hList, uint32_t hCount)
 
     // +load handled by prepare_load_methods()
 
+#undef IMAGE_END
+#undef IMAGE_START
+#undef PHASE_END
+#undef PHASE_START
 #undef EACH_HEADER
 }
 
@@ -2695,6 +3765,12 @@ __private_extern__ void _unload_image(header_info *hi)
     recursive_mutex_assert_locked(&loadMethodLock);
     rwlock_assert_writing(&runtimeLock);
 
+    if (RuntimeFrozen) {
+        _objc_fatal("image '%s' unloaded while the runtime is frozen; "
+                    "call objc_unfreezeRuntime() first", 
+                    _nameForHeader(hi->mhdr));
+    }
+
     // Unload unattached categories and categories waiting for +load.
 
     category_t **catlist = _getObjc2CategoryList(hi, &count);
@@ -2809,6 +3885,8 @@ _method_setImplementation(class_t *cls, method_t *m, IMP imp)
     m->imp = imp;
 
     // No cache flushing needed - cache contains Methods not IMPs.
+    // IMPs cached by objc_msgLookup callers are stale, though.
+    _cache_bumpMethodGeneration();
 
     if (vtable_containsSelector(newmethod(m)->name)) {
         // Will be slow if cls is NULL (i.e. unknown)
@@ -2816,6 +3894,11 @@ _method_setImplementation(class_t *cls, method_t *m, IMP imp)
         flushVtables(cls);
     }
 
+    if (isRRSelector(newmethod(m)->name)) {
+        // Will be slow if cls is NULL (i.e. unknown)
+        clearDefaultRR(cls);
+    }
+
     // fixme update monomorphism if necessary
 
     return old;
@@ -2826,9 +3909,11 @@ method_setImplementation(Method m, IMP imp)
 {
     // Don't know the class - will be slow if vtables are affected
     // fixme build list of classes whose Methods are known externally?
-    IMP result;
+    IMP result = NULL;
     rwlock_write(&runtimeLock);
-    result = _method_setImplementation(Nil, newmethod(m), imp);
+    if (!rejectIfFrozen("method_setImplementation")) {
+        result = _method_setImplementation(Nil, newmethod(m), imp);
+    }
     rwlock_unlock_write(&runtimeLock);
     return result;
 }
@@ -2842,10 +3927,17 @@ void method_exchangeImplementations(Method m1_gen, Method m2_gen)
 
     rwlock_write(&runtimeLock);
 
+    if (rejectIfFrozen("method_exchangeImplementations")) {
+        rwlock_unlock_write(&runtimeLock);
+        return;
+    }
+
     IMP m1_imp = m1->imp;
     m1->imp = m2->imp;
     m2->imp = m1_imp;
 
+    _cache_bumpMethodGeneration();
+
     if (vtable_containsSelector(m1->name)  ||  
         vtable_containsSelector(m2->name)) 
     {
@@ -2854,6 +3946,10 @@ void method_exchangeImplementations(Method m1_gen, Method m2_gen)
         flushVtables(NULL);
     }
 
+    if (isRRSelector(m1->name)  ||  isRRSelector(m2->name)) {
+        clearDefaultRR(NULL);
+    }
+
     // fixme update monomorphism if necessary
 
     rwlock_unlock_write(&runtimeLock);
@@ -2931,8 +4027,7 @@ _protocol_getMethod_nolock(protocol_t *proto, SEL sel,
     if (*mlistp) {
         method_list_t *mlist = *mlistp;
         if (!isMethodListFixedUp(mlist)) {
-            mlist = _memdup_internal(mlist, method_list_size(mlist));
-            fixupMethodList(mlist, YES/*always copy for simplicity*/);
+            mlist = fixupMethodListIfNeeded(mlist, YES/*always copy names for simplicity*/);
             *mlistp = mlist;
         }
         for (i = 0; i < mlist->count; i++) {
@@ -3035,15 +4130,16 @@ static BOOL _protocol_conformsToProtocol_nolock(protocol_t *self, protocol_t *ot
 /***********************************************************************
 * protocol_conformsToProtocol
 * Returns YES if self conforms to other.
-* Locking: acquires runtimeLock
+* Locking: acquires runtimeLock unless the runtime is frozen
 **********************************************************************/
 BOOL protocol_conformsToProtocol(Protocol *self, Protocol *other)
 {
     BOOL result;
-    rwlock_read(&runtimeLock);
+    BOOL locked;
+    rwlock_read_unless_frozen(&runtimeLock, locked);
     result = _protocol_conformsToProtocol_nolock(newprotocol(self), 
                                                  newprotocol(other));
-    rwlock_unlock_read(&runtimeLock);
+    rwlock_unlock_read_if_locked(&runtimeLock, locked);
     return result;
 }
 
@@ -3279,6 +4375,58 @@ objc_getClassList(Class *buffer, int bufferLen)
 }
 
 
+/***********************************************************************
+* objc_enumerateClasses
+* Calls function for each class until it returns NO. 
+* Returns the number of classes visited. Nothing is allocated.
+* Classes are copied to the stack in batches and function is called 
+* without the lock. Each batch restarts the table walk and skips the 
+* classes already visited, so the table may change between batches.
+* Locking: write-locks runtimeLock to realize all classes, then 
+*   read-locks runtimeLock to copy each batch
+**********************************************************************/
+#define ENUMERATE_CLASSES_BATCH 128
+
+unsigned int 
+objc_enumerateClasses(objc_class_enumerator function, void *context)
+{
+    unsigned int count = 0;
+    Class batch[ENUMERATE_CLASSES_BATCH];
+
+    if (!function) return 0;
+
+    rwlock_write(&runtimeLock);
+    realizeAllClasses();
+    rwlock_unlock_write(&runtimeLock);
+
+    while (1) {
+        NXHashTable *classes;
+        NXHashState state;
+        class_t *cls;
+        unsigned int skip = count;
+        unsigned int batchCount = 0;
+        unsigned int i;
+
+        rwlock_read(&runtimeLock);
+        classes = realizedClasses();
+        state = NXInitHashState(classes);
+        while (batchCount < ENUMERATE_CLASSES_BATCH  &&  
+               NXNextHashState(classes, &state, (void **)&cls))
+        {
+            if (skip) skip--;
+            else batch[batchCount++] = (Class)cls;
+        }
+        rwlock_unlock_read(&runtimeLock);
+
+        for (i = 0; i < batchCount; i++) {
+            count++;
+            if (!function(batch[i], context)) return count;
+        }
+        if (batchCount < ENUMERATE_CLASSES_BATCH) return count;
+    }
+}
+
+
 /***********************************************************************
 * objc_copyProtocolList
 * Returns pointers to all protocols.
@@ -3326,13 +4474,14 @@ objc_copyProtocolList(unsigned int *outCount)
 /***********************************************************************
 * objc_getProtocol
 * Get a protocol by name, or return NULL
-* Locking: read-locks runtimeLock
+* Locking: read-locks runtimeLock unless the runtime is frozen
 **********************************************************************/
 Protocol *objc_getProtocol(const char *name)
 {
-    rwlock_read(&runtimeLock); 
+    BOOL locked;
+    rwlock_read_unless_frozen(&runtimeLock, locked);
     Protocol *result = (Protocol *)NXMapGet(protocols(), name);
-    rwlock_unlock_read(&runtimeLock);
+    rwlock_unlock_read_if_locked(&runtimeLock, locked);
     return result;
 }
 
@@ -3354,6 +4503,7 @@ class_copyMethodList(Class cls_gen, unsigned int *outCount)
         return NULL;
     }
 
+    prepareForMethodQuery(cls);
     rwlock_read(&runtimeLock);
     
     assert(isRealized(cls));
@@ -3384,6 +4534,54 @@ class_copyMethodList(Class cls_gen, unsigned int *outCount)
 }
 
 
+/***********************************************************************
+* class_enumerateMethods
+* Calls function for each method in cls (not its superclasses), in 
+* class_copyMethodList order, until it returns NO. 
+* Returns the number of methods visited. Nothing is allocated.
+* The method list pointers are copied to the stack and function is 
+* called without the lock. Attached method lists never change.
+* Locking: read-locks runtimeLock to copy the list pointers
+**********************************************************************/
+unsigned int 
+class_enumerateMethods(Class cls_gen, objc_method_enumerator function, 
+                       void *context)
+{
+    struct class_t *cls = newcls(cls_gen);
+    unsigned int count = 0;
+    uint32_t listCount, l;
+
+    if (!cls  ||  !function) return 0;
+
+    prepareForMethodQuery(cls);
+    rwlock_read(&runtimeLock);
+
+    assert(isRealized(cls));
+
+    listCount = cls->data->methodListCount;
+    const method_list_t *lists[listCount + 1];
+    l = 0;
+    FOREACH_METHOD_LIST(mlist, cls, {
+        lists[l++] = mlist;
+    });
+    assert(l == listCount);
+
+    rwlock_unlock_read(&runtimeLock);
+
+    for (l = 0; l < listCount; l++) {
+        unsigned int i;
+        for (i = 0; i < lists[l]->count; i++) {
+            count++;
+            if (!function((Method)method_list_nth(lists[l], i), context)) {
+                return count;
+            }
+        }
+    }
+
+    return count;
+}
+
+
 /***********************************************************************
 * class_copyIvarList
 * fixme
@@ -3425,6 +4623,39 @@ class_copyIvarList(Class cls_gen, unsigned int *outCount)
 }
 
 
+/***********************************************************************
+* class_enumerateIvars
+* Calls function for each ivar declared by cls, in class_copyIvarList 
+* order, until it returns NO. 
+* Returns the number of ivars visited. Nothing is allocated.
+* Locking: none. A realized class's ivar list doesn't change.
+**********************************************************************/
+unsigned int 
+class_enumerateIvars(Class cls_gen, objc_ivar_enumerator function, 
+                     void *context)
+{
+    struct class_t *cls = newcls(cls_gen);
+    const ivar_list_t *ivars;
+    unsigned int count = 0;
+    unsigned int i;
+
+    if (!cls  ||  !function) return 0;
+
+    assert(isRealized(cls));
+
+    if ((ivars = cls->data->ro->ivars)) {
+        for (i = 0; i < ivars->count; i++) {
+            ivar_t *ivar = ivar_list_nth(ivars, i);
+            if (!ivar->offset) continue;  // anonymous bitfield
+            count++;
+            if (!function((Ivar)ivar, context)) break;
+        }
+    }
+
+    return count;
+}
+
+
 /***********************************************************************
 * class_copyPropertyList. Returns a heap block containing the 
 * properties declared in the class, or NULL if the class 
@@ -3445,6 +4676,7 @@ class_copyPropertyList(Class cls_gen, unsigned int *outCount)
         return NULL;
     }
 
+    prepareForMethodQuery(cls);
     rwlock_read(&runtimeLock);
 
     assert(isRealized(cls));
@@ -3474,6 +4706,43 @@ class_copyPropertyList(Class cls_gen, unsigned int *outCount)
 }
 
 
+/***********************************************************************
+* class_enumerateProperties
+* Calls function for each property declared by cls (not its 
+* superclasses), in class_copyPropertyList order, until it returns NO. 
+* Returns the number of properties visited. Nothing is allocated.
+* function is called without the lock. Property lists are only ever 
+* prepended to the chain, and never change once linked.
+* Locking: read-locks runtimeLock to read the head of the chain
+**********************************************************************/
+unsigned int 
+class_enumerateProperties(Class cls_gen, objc_property_enumerator function, 
+                          void *context)
+{
+    struct class_t *cls = newcls(cls_gen);
+    chained_property_list *plist;
+    unsigned int count = 0;
+
+    if (!cls  ||  !function) return 0;
+
+    prepareForMethodQuery(cls);
+    rwlock_read(&runtimeLock);
+    assert(isRealized(cls));
+    plist = cls->data->properties;
+    rwlock_unlock_read(&runtimeLock);
+
+    for ( ; plist; plist = plist->next) {
+        unsigned int i;
+        for (i = 0; i < plist->count; i++) {
+            count++;
+            if (!function((Property)&plist->list[i], context)) return count;
+        }
+    }
+
+    return count;
+}
+
+
 /***********************************************************************
 * _class_getLoadMethod
 * fixme
@@ -3581,7 +4850,7 @@ _category_getLoadMethod(Category cat)
 /***********************************************************************
 * class_copyProtocolList
 * fixme
-* Locking: read-locks runtimeLock
+* Locking: read-locks runtimeLock unless the runtime is frozen
 **********************************************************************/
 Protocol **
 class_copyProtocolList(Class cls_gen, unsigned int *outCount)
@@ -3592,13 +4861,15 @@ class_copyProtocolList(Class cls_gen, unsigned int *outCount)
     unsigned int count = 0;
     unsigned int i;
     Protocol **result = NULL;
+    BOOL locked;
     
     if (!cls) {
         if (outCount) *outCount = 0;
         return NULL;
     }
 
-    rwlock_read(&runtimeLock);
+    prepareForMethodQuery(cls);
+    rwlock_read_unless_frozen(&runtimeLock, locked);
 
     assert(isRealized(cls));
     
@@ -3617,13 +4888,59 @@ class_copyProtocolList(Class cls_gen, unsigned int *outCount)
         *r++ = NULL;
     }
 
-    rwlock_unlock_read(&runtimeLock);
+    rwlock_unlock_read_if_locked(&runtimeLock, locked);
 
     if (outCount) *outCount = count;
     return result;
 }
 
 
+/***********************************************************************
+* class_enumerateProtocols
+* Calls function for each protocol adopted by cls (not its 
+* superclasses), in class_copyProtocolList order, until it returns NO. 
+* Returns the number of protocols visited. Nothing is allocated.
+* The protocols are copied to the stack and function is called 
+* without the lock.
+* Locking: read-locks runtimeLock to copy the protocols
+**********************************************************************/
+unsigned int 
+class_enumerateProtocols(Class cls_gen, objc_protocol_enumerator function, 
+                         void *context)
+{
+    struct class_t *cls = newcls(cls_gen);
+    struct protocol_list_t **p;
+    unsigned int total = 0;
+    unsigned int count = 0;
+    unsigned int i;
+
+    if (!cls  ||  !function) return 0;
+
+    prepareForMethodQuery(cls);
+    rwlock_read(&runtimeLock);
+
+    assert(isRealized(cls));
+
+    for (p = cls->data->protocols; p  &&  *p; p++) {
+        total += (uint32_t)(*p)->count;
+    }
+    Protocol *protos[total + 1];
+    for (p = cls->data->protocols; p  &&  *p; p++) {
+        for (i = 0; i < (*p)->count; i++) {
+            protos[count++] = (Protocol *)remapProtocol((*p)->list[i]);
+        }
+    }
+
+    rwlock_unlock_read(&runtimeLock);
+
+    for (i = 0; i < total; i++) {
+        if (!function(protos[i], context)) return i + 1;
+    }
+
+    return total;
+}
+
+
 /***********************************************************************
 * _objc_copyClassNamesForImage
 * fixme
@@ -3791,14 +5108,16 @@ getMethodNoSuper_nolock(struct class_t *cls, SEL sel)
 /***********************************************************************
 * _class_getMethodNoSuper
 * fixme
-* Locking: read-locks runtimeLock
+* Locking: read-locks runtimeLock unless the runtime is frozen
 **********************************************************************/
 __private_extern__ Method 
 _class_getMethodNoSuper(Class cls, SEL sel)
 {
-    rwlock_read(&runtimeLock);
+    BOOL locked;
+    prepareForMethodQuery(newcls(cls));
+    rwlock_read_unless_frozen(&runtimeLock, locked);
     Method result = (Method)getMethodNoSuper_nolock(newcls(cls), sel);
-    rwlock_unlock_read(&runtimeLock);
+    rwlock_unlock_read_if_locked(&runtimeLock, locked);
     return result;
 }
 
@@ -3842,14 +5161,16 @@ getMethod_nolock(class_t *cls, SEL sel)
 /***********************************************************************
 * _class_getMethod
 * fixme
-* Locking: read-locks runtimeLock
+* Locking: read-locks runtimeLock unless the runtime is frozen
 **********************************************************************/
 __private_extern__ Method _class_getMethod(Class cls, SEL sel)
 {
     Method m;
-    rwlock_read(&runtimeLock);
+    BOOL locked;
+    prepareForMethodQuery(newcls(cls));
+    rwlock_read_unless_frozen(&runtimeLock, locked);
     m = (Method)getMethod_nolock(newcls(cls), sel);
-    rwlock_unlock_read(&runtimeLock);
+    rwlock_unlock_read_if_locked(&runtimeLock, locked);
     return m;
 }
 
@@ -3858,24 +5179,23 @@ __private_extern__ Method _class_getMethod(Class cls, SEL sel)
 * ABI-specific lookUpMethod helpers.
 * Locking: read- and write-locks runtimeLock.
 **********************************************************************/
-__private_extern__ void lockForMethodLookup(void)
+__private_extern__ BOOL lockForMethodLookup(void)
 {
-    rwlock_read(&runtimeLock);
+    BOOL locked;
+    rwlock_read_unless_frozen(&runtimeLock, locked);
+    return locked;
 }
-__private_extern__ void unlockForMethodLookup(void)
+__private_extern__ void unlockForMethodLookup(BOOL locked)
 {
-    rwlock_unlock_read(&runtimeLock);
+    rwlock_unlock_read_if_locked(&runtimeLock, locked);
 }
 
 __private_extern__ IMP prepareForMethodLookup(Class cls, SEL sel, BOOL init)
 {
     rwlock_assert_unlocked(&runtimeLock);
 
-    if (!isRealized(newcls(cls))) {
-        rwlock_write(&runtimeLock);
-        realizeClass(newcls(cls));
-        rwlock_unlock_write(&runtimeLock);
-    }
+    // Realizes the class too. 
+    prepareForMethodQuery(newcls(cls));
 
     if (init  &&  !_class_isInitialized(cls)) {
         _class_initialize (cls);
@@ -3892,17 +5212,19 @@ __private_extern__ IMP prepareForMethodLookup(Class cls, SEL sel, BOOL init)
 /***********************************************************************
 * class_getProperty
 * fixme
-* Locking: read-locks runtimeLock
+* Locking: read-locks runtimeLock unless the runtime is frozen
 **********************************************************************/
 Property class_getProperty(Class cls_gen, const char *name)
 {
     Property result = NULL;
     chained_property_list *plist;
     struct class_t *cls = newcls(cls_gen);
+    BOOL locked;
 
     if (!cls  ||  !name) return NULL;
 
-    rwlock_read(&runtimeLock);
+    prepareForMethodQuery(cls);
+    rwlock_read_unless_frozen(&runtimeLock, locked);
 
     assert(isRealized(cls));
 
@@ -3919,7 +5241,7 @@ Property class_getProperty(Class cls_gen, const char *name)
     }
 
  done:
-    rwlock_unlock_read(&runtimeLock);
+    rwlock_unlock_read_if_locked(&runtimeLock, locked);
 
     return result;
 }
@@ -4021,6 +5343,11 @@ _class_setInitialized(Class cls_gen)
     metacls = newcls(_class_getMeta(cls_gen));
     cls = getNonMetaClass(metacls);
 
+    // Vtables are built from method lists. A class method send only 
+    // methodizes the metaclass chain (see OBJC_LAZY_METHODIZATION).
+    methodizeClassIfNeeded(cls);
+    methodizeClassIfNeeded(metacls);
+
     // Update vtables (initially postponed pending +initialize completion)
     // Do cls first because root metacls is a subclass of root cls
     updateVtable(cls, YES);
@@ -4098,6 +5425,45 @@ _class_setFinalizeOnMainThread(Class cls)
 }
 
 
+/***********************************************************************
+* _class_supportsCustomWeak
+* Returns YES if cls or a superclass implements both 
+* -allowsWeakReference and -retainWeakReference. The answer comes from 
+* class flags, so it can be asked with a weak reference shard locked. 
+* A class that is not methodized yet answers NO unless methodize is YES.
+* Locking: none, unless methodize is YES and cls is not methodized yet; 
+*   then acquires runtimeLock
+**********************************************************************/
+__private_extern__ BOOL
+_class_supportsCustomWeak(Class cls_gen, BOOL methodize)
+{
+    class_t *cls = newcls(cls_gen);
+    uint32_t flags;
+
+    if (methodize) prepareForMethodQuery(cls);
+    flags = cls->data->flags;
+    return ((flags & (RW_REALIZED|RW_METHODIZED|RW_WEAK_REFERENCE_HOOKS)) == 
+            (RW_REALIZED|RW_METHODIZED|RW_WEAK_REFERENCE_HOOKS)) ? YES : NO;
+}
+
+
+/***********************************************************************
+* _class_hasDefaultRR
+* Returns YES if objc_retain and friends may skip message dispatch 
+* for instances of cls. Unrealized classes never qualify; the test 
+* for RW_REALIZED keeps class_ro_t flags from being misread.
+* Locking: none
+**********************************************************************/
+__private_extern__ BOOL
+_class_hasDefaultRR(Class cls_gen)
+{
+    class_t *cls = newcls(cls_gen);
+    uint32_t flags = cls->data->flags;
+    return ((flags & (RW_REALIZED|RW_HAS_DEFAULT_RR)) == 
+            (RW_REALIZED|RW_HAS_DEFAULT_RR)) ? YES : NO;
+}
+
+
 /***********************************************************************
 * _class_instancesHaveAssociatedObjects
 * May manipulate unrealized future classes in the CF-bridged case.
@@ -4124,6 +5490,34 @@ _class_assertInstancesHaveAssociatedObjects(Class cls_gen)
 }
 
 
+/***********************************************************************
+* _class_instancesHaveWeakReferrers
+* May manipulate unrealized future classes in the CF-bridged case.
+**********************************************************************/
+__private_extern__ BOOL
+_class_instancesHaveWeakReferrers(Class cls_gen)
+{
+    class_t *cls = newcls(cls_gen);
+    assert(isFuture(cls)  ||  isRealized(cls));
+    return (cls->data->flags & RW_INSTANCES_HAVE_WEAK_REFERRERS) ? YES : NO;
+}
+
+
+/***********************************************************************
+* _class_assertInstancesHaveWeakReferrers
+* May manipulate unrealized future classes in the CF-bridged case.
+**********************************************************************/
+__private_extern__ void
+_class_assertInstancesHaveWeakReferrers(Class cls_gen)
+{
+    class_t *cls = newcls(cls_gen);
+    assert(isFuture(cls)  ||  isRealized(cls));
+    if (!(cls->data->flags & RW_INSTANCES_HAVE_WEAK_REFERRERS)) {
+        changeInfo(cls, RW_INSTANCES_HAVE_WEAK_REFERRERS, 0);
+    }
+}
+
+
 /***********************************************************************
 * Locking: none
 * fixme assert realized to get superclass remapping?
@@ -4247,22 +5641,23 @@ class_setWeakIvarLayout(Class cls_gen, const char *layout)
 /***********************************************************************
 * _class_getVariable
 * fixme
-* Locking: read-locks runtimeLock
+* Locking: read-locks runtimeLock unless the runtime is frozen
 **********************************************************************/
 __private_extern__ Ivar 
 _class_getVariable(Class cls, const char *name)
 {
-    rwlock_read(&runtimeLock);
+    BOOL locked;
+    rwlock_read_unless_frozen(&runtimeLock, locked);
 
     for ( ; cls != Nil; cls = class_getSuperclass(cls)) {
         struct ivar_t *ivar = getIvar(newcls(cls), name);
         if (ivar) {
-            rwlock_unlock_read(&runtimeLock);
+            rwlock_unlock_read_if_locked(&runtimeLock, locked);
             return (Ivar)ivar;
         }
     }
 
-    rwlock_unlock_read(&runtimeLock);
+    rwlock_unlock_read_if_locked(&runtimeLock, locked);
 
     return NULL;
 }
@@ -4308,7 +5703,7 @@ BOOL class_conformsToProtocol(Class cls_gen, Protocol *proto)
 **********************************************************************/
 static IMP 
 _class_addMethod(Class cls_gen, SEL name, IMP imp, 
-                 const char *types, BOOL replace)
+                 const char *types, BOOL replace, BOOL *outRejected)
 {
     struct class_t *cls = newcls(cls_gen);
     IMP result = NULL;
@@ -4319,6 +5714,15 @@ _class_addMethod(Class cls_gen, SEL name, IMP imp,
 
     assert(isRealized(cls));
 
+    *outRejected = rejectIfFrozen(replace ? "class_replaceMethod" 
+                                          : "class_addMethod");
+    if (*outRejected) {
+        rwlock_unlock_write(&runtimeLock);
+        return NULL;
+    }
+
+    methodizeClassIfNeeded(cls);
+
     method_t *m;
     if ((m = getMethodNoSuper_nolock(cls, name))) {
         // already exists
@@ -4356,8 +5760,9 @@ class_addMethod(Class cls, SEL name, IMP imp, const char *types)
 {
     if (!cls) return NO;
 
-    IMP old = _class_addMethod(cls, name, imp, types, NO);
-    return old ? NO : YES;
+    BOOL rejected;
+    IMP old = _class_addMethod(cls, name, imp, types, NO, &rejected);
+    return (old  ||  rejected) ? NO : YES;
 }
 
 
@@ -4366,7 +5771,8 @@ class_replaceMethod(Class cls, SEL name, IMP imp, const char *types)
 {
     if (!cls) return NULL;
 
-    return _class_addMethod(cls, name, imp, types, YES);
+    BOOL rejected;
+    return _class_addMethod(cls, name, imp, types, YES, &rejected);
 }
 
 
@@ -4465,7 +5871,13 @@ BOOL class_addProtocol(Class cls_gen, Protocol *protocol_gen)
 
     rwlock_write(&runtimeLock);
 
+    if (rejectIfFrozen("class_addProtocol")) {
+        rwlock_unlock_write(&runtimeLock);
+        return NO;
+    }
+
     assert(isRealized(cls));
+    methodizeClassIfNeeded(cls);
     
     // fixme optimize
     plist = _malloc_internal(sizeof(protocol_list_t) + sizeof(protocol_t *));
@@ -4494,7 +5906,7 @@ BOOL class_addProtocol(Class cls_gen, Protocol *protocol_gen)
 /***********************************************************************
 * look_up_class
 * Look up a class by name, and realize it.
-* Locking: acquires runtimeLock
+* Locking: acquires runtimeLock only if the class needs to be realized
 **********************************************************************/
 __private_extern__ id 
 look_up_class(const char *name, 
@@ -4503,10 +5915,8 @@ look_up_class(const char *name,
 {
     if (!name) return nil;
 
-    rwlock_read(&runtimeLock);
-    class_t *result = getClass(name);
-    BOOL unrealized = result  &&  !isRealized(result);
-    rwlock_unlock_read(&runtimeLock);
+    class_t *result = getClassNoLock(name);
+    BOOL unrealized = result  &&  !isRealizedComplete(result);
     if (unrealized) {
         rwlock_write(&runtimeLock);
         realizeClass(result);
@@ -4530,8 +5940,14 @@ objc_duplicateClass(Class original_gen, const char *name,
 
     rwlock_write(&runtimeLock);
 
+    if (rejectIfFrozen("objc_duplicateClass")) {
+        rwlock_unlock_write(&runtimeLock);
+        return Nil;
+    }
+
     assert(isRealized(original));
     assert(!isMetaClass(original));
+    methodizeClassIfNeeded(original);
 
     duplicate = (struct class_t *)
         _calloc_class(instanceSize(original->isa) + extraBytes);
@@ -4558,7 +5974,11 @@ objc_duplicateClass(Class original_gen, const char *name,
     if (original->data->methods) {
         duplicate->data->methods = 
             _memdup_internal(original->data->methods, 
-                             malloc_size(original->data->methods));
+                             original->data->methodListCapacity * 
+                             sizeof(method_list_t *));
+        duplicate->data->methodListCount = original->data->methodListCount;
+        duplicate->data->methodListCapacity = 
+            original->data->methodListCapacity;
         method_list_t **mlistp = duplicate->data->methods;
         for (mlistp = duplicate->data->methods; *mlistp; mlistp++) {
             *mlistp = _memdup_internal(*mlistp, method_list_size(*mlistp));
@@ -4617,11 +6037,21 @@ static void objc_initializeClassPair_internal(Class superclass_gen, const char *
     cls->vtable = _objc_empty_vtable;
     meta->vtable = _objc_empty_vtable;
 
-    cls->data->flags = RW_CONSTRUCTING | RW_COPIED_RO | RW_REALIZED;
-    meta->data->flags = RW_CONSTRUCTING | RW_COPIED_RO | RW_REALIZED;
+    cls->data->flags = RW_CONSTRUCTING | RW_COPIED_RO | RW_REALIZED | RW_REALIZED_COMPLETE | RW_METHODIZED;
+    meta->data->flags = RW_CONSTRUCTING | RW_COPIED_RO | RW_REALIZED | RW_REALIZED_COMPLETE | RW_METHODIZED;
     cls->data->version = 0;
     meta->data->version = 7;
 
+    // Weak reference hooks are inherited (see methodizeClass)
+    if (superclass) {
+        methodizeClassIfNeeded(superclass);
+        methodizeClassIfNeeded(superclass->isa);
+        cls->data->flags |= 
+            superclass->data->flags & RW_WEAK_REFERENCE_HOOKS;
+        meta->data->flags |= 
+            superclass->isa->data->flags & RW_WEAK_REFERENCE_HOOKS;
+    }
+
     cls_ro_w->flags = 0;
     meta_ro_w->flags = RO_META;
     if (!superclass) {
@@ -4706,6 +6136,11 @@ Class objc_allocateClassPair(Class superclass_gen, const char *name,
 
     rwlock_write(&runtimeLock);
 
+    if (rejectIfFrozen("objc_allocateClassPair")) {
+        rwlock_unlock_write(&runtimeLock);
+        return Nil;
+    }
+
     //
     // Common superclass integrity checks with objc_initializeClassPair
     //
@@ -4754,6 +6189,11 @@ void objc_registerClassPair(Class cls_gen)
     
     rwlock_write(&runtimeLock);
 
+    if (rejectIfFrozen("objc_registerClassPair")) {
+        rwlock_unlock_write(&runtimeLock);
+        return;
+    }
+
     if ((cls->data->flags & RW_CONSTRUCTED)  ||  
         (cls->isa->data->flags & RW_CONSTRUCTED)) 
     {
@@ -4778,6 +6218,7 @@ void objc_registerClassPair(Class cls_gen)
     cls->isa->data->flags &= ~RW_CONSTRUCTING;
     cls->data->flags |= RW_CONSTRUCTED;
     cls->isa->data->flags |= RW_CONSTRUCTED;
+    if (classHasDefaultRR(cls)) cls->data->flags |= RW_HAS_DEFAULT_RR;
 
     // Add to realized and uninitialized classes
     addNamedClass(cls, cls->data->ro->name);
@@ -4871,6 +6312,11 @@ void objc_disposeClassPair(Class cls_gen)
 
     rwlock_write(&runtimeLock);
 
+    if (rejectIfFrozen("objc_disposeClassPair")) {
+        rwlock_unlock_write(&runtimeLock);
+        return;
+    }
+
     if (!(cls->data->flags & (RW_CONSTRUCTED|RW_CONSTRUCTING))  ||  
         !(cls->isa->data->flags & (RW_CONSTRUCTED|RW_CONSTRUCTING))) 
     {
@@ -4948,7 +6394,8 @@ object_copyFromZone(id oldObj, size_t extraBytes, void *zone)
     id obj;
     size_t size;
 
-    if (!oldObj) return nil;
+    // A tagged pointer has no storage to copy.
+    if (!oldObj  ||  _objc_isTaggedPointer(oldObj)) return nil;
 
     size = _class_getInstanceSize(oldObj->isa) + extraBytes;
     if (zone) {
@@ -5034,7 +6481,7 @@ _objc_fixupMessageRef(id obj, struct objc_super2 *supr, message_ref *msg)
 
     if (!supr) {
         // normal message - search obj->isa for the method implementation
-        isa = (class_t *)obj->isa;
+        isa = (class_t *)_object_getIsa(obj);
         
         if (!isRealized(isa)) {
             // obj is a class object, isa is its metaclass
@@ -5128,6 +6575,7 @@ static class_t *setSuperclass(class_t *cls, class_t *newSuper)
     flushCaches(cls->isa);
     flushVtables(cls);
     flushVtables(cls->isa);
+    clearDefaultRR(cls);
 
     return oldSuper;
 }
@@ -5140,7 +6588,11 @@ Class class_setSuperclass(Class cls_gen, Class newSuper_gen)
     class_t *oldSuper;
 
     rwlock_write(&runtimeLock);
-    oldSuper = setSuperclass(cls, newSuper);
+    if (rejectIfFrozen("class_setSuperclass")) {
+        oldSuper = getSuperclass(cls);
+    } else {
+        oldSuper = setSuperclass(cls, newSuper);
+    }
     rwlock_unlock_write(&runtimeLock);
 
     return (Class)oldSuper;
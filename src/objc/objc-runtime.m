@@ -64,6 +64,8 @@ __private_extern__ int PrintExceptions = -1; // env OBJC_PRINT_EXCEPTIONS
 __private_extern__ int PrintDeprecation = -1;// env OBJC_PRINT_DEPRECATION_WARNINGS
 __private_extern__ int PrintReplacedMethods = -1; // env OBJC_PRINT_REPLACED_METHODS
 __private_extern__ int PrintCaches = -1;     // env OBJC_PRINT_CACHE_SETUP
+__private_extern__ int PrintStartupTimes = -1; // env OBJC_PRINT_STARTUP_TIMES
+__private_extern__ int PrintMethodFixups = -1; // env OBJC_PRINT_METHOD_FIXUPS
 
 __private_extern__ int UseInternalZone = -1; // env OBJC_USE_INTERNAL_ZONE
 
@@ -73,7 +75,14 @@ __private_extern__ int DebugNilSync = -1;    // env OBJC_DEBUG_NIL_SYNC
 
 __private_extern__ int DisableVtables = -1;  // env OBJC_DISABLE_VTABLES
 __private_extern__ int DisablePreopt = -1;   // env OBJC_DISABLE_PREOPTIMIZATION
+__private_extern__ int DisableParallelImages = -1; // env OBJC_DISABLE_PARALLEL_IMAGES
+__private_extern__ int LazyMethodization = -1; // env OBJC_LAZY_METHODIZATION
 __private_extern__ int DebugFinalizers = -1; // env OBJC_DEBUG_FINALIZERS
+
+__private_extern__ const char *VtableSelectorsFile = NULL; // env OBJC_VTABLE_SELECTORS
+__private_extern__ const char *LaunchCacheFile = NULL; // env OBJC_LAUNCH_CACHE
+__private_extern__ const char *StartupTimesFile = NULL; // env OBJC_STARTUP_TIMES_FILE
+__private_extern__ const char *ForkSelectorsFile = NULL; // env OBJC_FORK_SELECTORS
 #endif
 
 
@@ -90,6 +99,10 @@ __private_extern__ SEL SEL_cxx_destruct = NULL;
 __private_extern__ SEL SEL_retain = NULL;
 __private_extern__ SEL SEL_release = NULL;
 __private_extern__ SEL SEL_autorelease = NULL;
+__private_extern__ SEL SEL_retainCount = NULL;
+__private_extern__ SEL SEL_dealloc = NULL;
+__private_extern__ SEL SEL_allowsWeakReference = NULL;
+__private_extern__ SEL SEL_retainWeakReference = NULL;
 __private_extern__ SEL SEL_copy = NULL;
 __private_extern__ SEL SEL_finalize = NULL;
 
@@ -201,6 +214,127 @@ __private_extern__ const char *_nameForHeader(const headerType *header)
 }
 
 
+/***********************************************************************
+* Header registry.
+* Headers are indexed by mach header (headersByMhdr) and by the address 
+* range of their data segment (headerRanges, sorted by start address), 
+* so that duplicate checks and address-to-image queries don't walk 
+* the header list.
+* Both are maintained by _objc_appendHeader and _objc_removeHeader.
+**********************************************************************/
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    header_info *hi;
+} header_range;
+
+static NXMapTable *headersByMhdr = NULL;
+static header_range *headerRanges = NULL;
+static unsigned headerRangeCount = 0;
+static unsigned headerRangeCapacity = 0;
+
+static BOOL getHeaderRange(const header_info *hi, 
+                           uintptr_t *start, uintptr_t *end)
+{
+    const segmentType *segHeader = hi->os.dataSegmentHeader;
+    if (!segHeader  ||  segHeader->filesize == 0) return NO;
+    *start = segHeader->vmaddr + hi->os.image_slide;
+    *end = *start + segHeader->filesize;
+    return YES;
+}
+
+// Returns the index of the first range starting above addr.
+static unsigned headerRangeUpperBound(uintptr_t addr)
+{
+    unsigned low = 0;
+    unsigned high = headerRangeCount;
+    while (low < high) {
+        unsigned mid = low + (high - low) / 2;
+        if (headerRanges[mid].start <= addr) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+static void addHeaderToRegistry(header_info *hi)
+{
+    uintptr_t start, end;
+    unsigned index;
+
+    if (!headersByMhdr) {
+        headersByMhdr = 
+            NXCreateMapTableFromZone(NXPtrValueMapPrototype, 32, 
+                                     _objc_internal_zone());
+    }
+    NXMapInsert(headersByMhdr, hi->mhdr, hi);
+
+    if (!getHeaderRange(hi, &start, &end)) return;
+
+    if (headerRangeCount == headerRangeCapacity) {
+        headerRangeCapacity = headerRangeCapacity ? headerRangeCapacity*2 : 32;
+        headerRanges = (header_range *)
+            _realloc_internal(headerRanges, 
+                              headerRangeCapacity * sizeof(header_range));
+    }
+    index = headerRangeUpperBound(start);
+    memmove(&headerRanges[index+1], &headerRanges[index], 
+            (headerRangeCount - index) * sizeof(header_range));
+    headerRanges[index].start = start;
+    headerRanges[index].end = end;
+    headerRanges[index].hi = hi;
+    headerRangeCount++;
+}
+
+static void removeHeaderFromRegistry(header_info *hi)
+{
+    uintptr_t start, end;
+    unsigned index;
+
+    if (headersByMhdr) NXMapRemove(headersByMhdr, hi->mhdr);
+
+    if (!getHeaderRange(hi, &start, &end)) return;
+
+    index = headerRangeUpperBound(start);
+    while (index--) {
+        if (headerRanges[index].hi == hi) {
+            memmove(&headerRanges[index], &headerRanges[index+1], 
+                    (headerRangeCount - index - 1) * sizeof(header_range));
+            headerRangeCount--;
+            return;
+        }
+        if (headerRanges[index].start != start) return;
+    }
+}
+
+
+/***********************************************************************
+* _headerForMachHeader
+* Return the header_info for the given mach header, or NULL if the 
+* image has not been added.
+**********************************************************************/
+__private_extern__ header_info *_headerForMachHeader(const headerType *mhdr)
+{
+    if (!headersByMhdr) return NULL;
+    return (header_info *)NXMapGet(headersByMhdr, mhdr);
+}
+
+
+/***********************************************************************
+* _headerForAddress
+* Return the header_info whose data segment contains addr, or NULL.
+* addr can be a class or a category.
+**********************************************************************/
+__private_extern__ header_info *_headerForAddress(const void *addr)
+{
+    unsigned index = headerRangeUpperBound((uintptr_t)addr);
+    if (index == 0) return NULL;
+    if ((uintptr_t)addr < headerRanges[index-1].end) {
+        return headerRanges[index-1].hi;
+    }
+    return NULL;
+}
+
+
 /***********************************************************************
 * _objc_appendHeader.  Add a newly-constructed header_info to the list. 
 **********************************************************************/
@@ -223,6 +357,8 @@ __private_extern__ void _objc_appendHeader(header_info *hi)
         LastHeader->next = hi;
         LastHeader = hi;
     }
+
+    addHeaderToRegistry(hi);
 }
 
 
@@ -250,6 +386,7 @@ __private_extern__ void _objc_removeHeader(header_info *hi)
             }
 
             HeaderCount--;
+            removeHeaderFromRegistry(hi);
             break;
         }
     }
@@ -335,6 +472,10 @@ void objc_environ_init(void)
            "log methods replaced by category implementations");
     OPTION(PrintDeprecation, OBJC_PRINT_DEPRECATION_WARNINGS, 
            "warn about calls to deprecated runtime functions");
+    OPTION(PrintStartupTimes, OBJC_PRINT_STARTUP_TIMES, 
+           "log time spent in each image loading phase and +load method");
+    OPTION(PrintMethodFixups, OBJC_PRINT_METHOD_FIXUPS, 
+           "log method list bytes fixed up in place vs. copied at exit");
 
     OPTION(DebugUnload, OBJC_DEBUG_UNLOAD,
            "warn about poorly-behaving bundles when unloaded");
@@ -352,8 +493,36 @@ void objc_environ_init(void)
            "disable vtable dispatch");
     OPTION(DisablePreopt, OBJC_DISABLE_PREOPTIMIZATION,
            "disable preoptimization courtesy of dyld shared cache");
+    OPTION(DisableParallelImages, OBJC_DISABLE_PARALLEL_IMAGES,
+           "process newly-loaded images on a single thread");
+    OPTION(LazyMethodization, OBJC_LAZY_METHODIZATION,
+           "attach method lists and categories to a class when it is first searched for methods, not when it is realized");
 
 #undef OPTION
+
+    // Options that take a value rather than YES.
+#define STRING_OPTION(var, env, help) \
+    { \
+        char *value = getenv(#env); \
+        if (secure) { \
+            if (value) _objc_inform(#env " ignored when running setuid or setgid"); \
+        } else { \
+            if (PrintHelp) _objc_inform(#env ": " help); \
+            if (value  &&  value[0]) var = value; \
+            if (PrintOptions && var) _objc_inform(#env " is %s", var); \
+        } \
+    }
+
+    STRING_OPTION(VtableSelectorsFile, OBJC_VTABLE_SELECTORS, 
+                  "read vtable selectors from this file (one per line, optionally preceded by a send count)");
+    STRING_OPTION(LaunchCacheFile, OBJC_LAUNCH_CACHE, 
+                  "reuse selector fixups saved in this file by a previous launch");
+    STRING_OPTION(StartupTimesFile, OBJC_STARTUP_TIMES_FILE, 
+                  "append startup times to this file as tab-separated lines (pid, phase, image, detail, nanoseconds)");
+    STRING_OPTION(ForkSelectorsFile, OBJC_FORK_SELECTORS, 
+                  "objc_prepareForFork(OBJC_FORK_FILL_CACHES) caches these selectors (same format as OBJC_VTABLE_SELECTORS)");
+
+#undef STRING_OPTION
 #endif
 }
 
@@ -390,6 +559,63 @@ logReplacedMethod(const char *className, SEL s,
 
 
 
+/***********************************************************************
+* _objc_startupTimeNow
+* Monotonic time in nanoseconds, for OBJC_PRINT_STARTUP_TIMES.
+**********************************************************************/
+__private_extern__ uint64_t _objc_startupTimeNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/***********************************************************************
+* _objc_logStartupTime
+* OBJC_PRINT_STARTUP_TIMES and OBJC_STARTUP_TIMES_FILE implementation.
+* phase is required; hi and detail may be NULL.
+* Callers check StartupTimesEnabled first.
+**********************************************************************/
+static mutex_t startupTimesLock = MUTEX_INITIALIZER;
+static FILE *startupTimesOut = NULL;
+
+__private_extern__ void 
+_objc_logStartupTime(const char *phase, const header_info *hi, 
+                     const char *detail, uint64_t nanoseconds)
+{
+    const char *image = hi ? _nameForHeader(hi->mhdr) : "-";
+
+    if (PrintStartupTimes) {
+        _objc_inform("STARTUP: %s%s%s%s%s: %llu.%03llu ms", 
+                     phase, 
+                     hi ? " " : "", hi ? image : "", 
+                     detail ? " " : "", detail ? detail : "", 
+                     nanoseconds / 1000000, 
+                     (nanoseconds / 1000) % 1000);
+    }
+
+    if (StartupTimesFile) {
+        mutex_lock(&startupTimesLock);
+        if (!startupTimesOut) {
+            startupTimesOut = fopen(StartupTimesFile, "a");
+            if (!startupTimesOut) {
+                _objc_inform("STARTUP: can't open %s (%s)", 
+                             StartupTimesFile, strerror(errno));
+                StartupTimesFile = NULL;
+            }
+        }
+        if (startupTimesOut) {
+            fprintf(startupTimesOut, "%d\t%s\t%s\t%s\t%llu\n", 
+                    (int)getpid(), phase, image, detail ? detail : "-", 
+                    nanoseconds);
+            fflush(startupTimesOut);
+        }
+        mutex_unlock(&startupTimesLock);
+    }
+}
+
+
 /***********************************************************************
 * objc_setMultithreaded.
 **********************************************************************/
@@ -431,6 +657,14 @@ __private_extern__ void _objc_pthread_destroyspecific(void *arg)
 {
     _objc_pthread_data *data = (_objc_pthread_data *)arg;
     if (data != NULL) {
+        // Drain pools the thread left open first; dealloc methods may 
+        // need the rest of the data, and may autorelease more objects.
+        if (data->autoreleasePage) {
+            tls_set(_objc_pthread_key, data);
+            _destroyAutoreleasePages(data);
+            tls_set(_objc_pthread_key, NULL);
+        }
+
         _destroyInitializingClassList(data->initializingClasses);
         _destroyLockList(data->lockList);
         _destroySyncCache(data->syncCache);
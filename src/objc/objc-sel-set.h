@@ -37,5 +37,7 @@ struct __objc_sel_set;
 extern struct __objc_sel_set *__objc_sel_set_create(uint32_t capacity);
 extern SEL __objc_sel_set_get(struct __objc_sel_set *sset, SEL candidate);
 extern void __objc_sel_set_add(struct __objc_sel_set *sset, SEL value);
+extern SEL __objc_sel_set_get_hashed(struct __objc_sel_set *sset, SEL candidate, uint32_t hash);
+extern void __objc_sel_set_add_hashed(struct __objc_sel_set *sset, SEL value, uint32_t hash);
             
 __END_DECLS
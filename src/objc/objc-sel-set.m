@@ -88,11 +88,21 @@ struct __objc_sel_set_finds {
 };
 
 // candidate may not be 0; match is 0 if not present
-static struct __objc_sel_set_finds __objc_sel_set_findBuckets(struct __objc_sel_set *sset, SEL candidate) {
+// hash must be _objc_strhash(candidate)
+// May run without selLock while the runtime is frozen, concurrently with 
+// __objc_sel_set_add_hashed: _bucketsNum is read before _buckets, and 
+// the adder publishes them in the opposite order, so the bucket array 
+// read is never smaller than the count used to index it. A stale count 
+// can only cause a transient miss; __sel_registerName re-checks misses 
+// under selLock.
+static struct __objc_sel_set_finds __objc_sel_set_findBucketsHashed(struct __objc_sel_set *sset, SEL candidate, uint32_t hash) {
     struct __objc_sel_set_finds ret = {0, 0xffffffff};
-    uint32_t probe = CONSTRAIN((uint32_t)_objc_strhash((const char *)candidate), sset->_bucketsNum);
+    uint32_t bucketsNum = sset->_bucketsNum;
+    if (RuntimeFrozen) OSMemoryBarrier();
+    SEL *buckets = sset->_buckets;
+    uint32_t probe = CONSTRAIN(hash, bucketsNum);
     for (;;) {
-        SEL currentSel = sset->_buckets[probe];
+        SEL currentSel = buckets[probe];
         if (!currentSel) {
             ret.nomatch = probe;
             return ret;
@@ -100,12 +110,16 @@ static struct __objc_sel_set_finds __objc_sel_set_findBuckets(struct __objc_sel_
             ret.match = currentSel;
         }
         probe++;
-        if (sset->_bucketsNum <= probe) {
-            probe -= sset->_bucketsNum;
+        if (bucketsNum <= probe) {
+            probe -= bucketsNum;
         }
     }
 }
 
+static struct __objc_sel_set_finds __objc_sel_set_findBuckets(struct __objc_sel_set *sset, SEL candidate) {
+    return __objc_sel_set_findBucketsHashed(sset, candidate, _objc_strhash((const char *)candidate));
+}
+
 // create a set with given starting capacity, will resize as needed
 __private_extern__ struct __objc_sel_set *__objc_sel_set_create(uint32_t capacity) {
     uint32_t idx;
@@ -128,29 +142,53 @@ __private_extern__ SEL __objc_sel_set_get(struct __objc_sel_set *sset, SEL candi
     return __objc_sel_set_findBuckets(sset, candidate).match;
 }
 
+// Same as __objc_sel_set_get, with hash already computed by the caller.
+// Does not modify the set, so concurrent calls are safe as long as 
+// nobody is adding.
+__private_extern__ SEL __objc_sel_set_get_hashed(struct __objc_sel_set *sset, SEL candidate, uint32_t hash) {
+    return __objc_sel_set_findBucketsHashed(sset, candidate, hash).match;
+}
+
 // value may not be 0; should not be called unless it is known the value is not in the set
 __private_extern__ void __objc_sel_set_add(struct __objc_sel_set *sset, SEL value) {
+    __objc_sel_set_add_hashed(sset, value, _objc_strhash((const char *)value));
+}
+
+// Same as __objc_sel_set_add, with hash already computed by the caller.
+__private_extern__ void __objc_sel_set_add_hashed(struct __objc_sel_set *sset, SEL value, uint32_t hash) {
     if (sset->_count == sset->_capacity) {
         SEL *oldbuckets = sset->_buckets;
         uint32_t oldnbuckets = sset->_bucketsNum;
         uint32_t idx, capacity = sset->_count + 1;
         for (idx = 0; __objc_sel_set_capacities[idx] < capacity; idx++);
         if (SIZE <= idx) _objc_fatal("objc_sel_set failure");
-        sset->_capacity = __objc_sel_set_capacities[idx];
-        sset->_bucketsNum = __objc_sel_set_buckets[idx];
-        sset->_buckets = _calloc_internal(sset->_bucketsNum, sizeof(SEL));
-        if (!sset->_buckets) _objc_fatal("objc_sel_set failure");
+        uint32_t ncapacity = __objc_sel_set_capacities[idx];
+        uint32_t nbuckets = __objc_sel_set_buckets[idx];
+        SEL *buckets = _calloc_internal(nbuckets, sizeof(SEL));
+        if (!buckets) _objc_fatal("objc_sel_set failure");
         for (idx = 0; idx < oldnbuckets; idx++) {
             SEL currentSel = oldbuckets[idx];
             if (currentSel) {
-                uint32_t nomatch = __objc_sel_set_findBuckets(sset, currentSel).nomatch;
-                sset->_buckets[nomatch] = currentSel;
+                uint32_t probe = CONSTRAIN(_objc_strhash((const char *)currentSel), nbuckets);
+                while (buckets[probe]) {
+                    if (++probe == nbuckets) probe = 0;
+                }
+                buckets[probe] = currentSel;
             }
         }
-        _free_internal(oldbuckets);
+        // Publish the filled array before its size (see findBucketsHashed).
+        OSMemoryBarrier();
+        sset->_buckets = buckets;
+        OSMemoryBarrier();
+        sset->_bucketsNum = nbuckets;
+        sset->_capacity = ncapacity;
+        // Frozen readers may still be scanning the old array.
+        if (!RuntimeFrozen) _free_internal(oldbuckets);
     }
     {
-        uint32_t nomatch = __objc_sel_set_findBuckets(sset, value).nomatch;
+        uint32_t nomatch = __objc_sel_set_findBucketsHashed(sset, value, hash).nomatch;
+        // The name must be visible before the slot that points to it.
+        OSMemoryBarrier();
         sset->_buckets[nomatch] = value;
         sset->_count++;
     }
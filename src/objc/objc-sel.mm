@@ -133,17 +133,30 @@ BOOL sel_isMapped(SEL name)
     result = _objc_search_builtins((const char *)name);
     if (result) return YES;
 
-    rwlock_read(&selLock);
+    BOOL locked;
+    rwlock_read_unless_frozen(&selLock, locked);
     if (_objc_selectors) {
         result = __objc_sel_set_get(_objc_selectors, name);
     }
-    rwlock_unlock_read(&selLock);
+    rwlock_unlock_read_if_locked(&selLock, locked);
+    if (result) return YES;
+
+    // An unlocked read can miss while the set is growing. 
+    // Only a hit is trusted; check a miss again under selLock.
+    if (!locked) {
+        rwlock_read(&selLock);
+        if (_objc_selectors) {
+            result = __objc_sel_set_get(_objc_selectors, name);
+        }
+        rwlock_unlock_read(&selLock);
+    }
     return result ? YES : NO;
 }
 
 static SEL __sel_registerName(const char *name, int lock, int copy) 
 {
     SEL result = 0;
+    BOOL locked = NO;
 
     if (lock) rwlock_assert_unlocked(&selLock);
     else rwlock_assert_writing(&selLock);
@@ -152,11 +165,13 @@ static SEL __sel_registerName(const char *name, int lock, int copy)
     result = _objc_search_builtins(name);
     if (result) return result;
     
-    if (lock) rwlock_read(&selLock);
+    // While the runtime is frozen the set is read without selLock; 
+    // __objc_sel_set_add keeps it consistent for such readers.
+    if (lock) rwlock_read_unless_frozen(&selLock, locked);
     if (_objc_selectors) {
         result = __objc_sel_set_get(_objc_selectors, (SEL)name);
     }
-    if (lock) rwlock_unlock_read(&selLock);
+    rwlock_unlock_read_if_locked(&selLock, locked);
     if (result) return result;
 
     // No match. Insert.
@@ -191,6 +206,55 @@ __private_extern__ SEL sel_registerNameNoLock(const char *name, BOOL copy) {
     return __sel_registerName(name, 0, copy);  // NO lock, maybe copy
 }
 
+/***********************************************************************
+* sel_lookupNameNoLock
+* Returns the registered selector for name, or 0 if there is none yet.
+* *outHash is set to the selector table hash of name, for a later 
+* sel_registerNameHashedNoLock. 
+* Safe to call from several threads at once: the caller holds selLock 
+* for writing and nobody registers selectors until the lookups finish.
+* Locking: selLock must be held for writing by the caller's thread
+**********************************************************************/
+__private_extern__ SEL sel_lookupNameNoLock(const char *name, uint32_t *outHash)
+{
+    SEL result;
+
+    *outHash = 0;
+    if (!name) return (SEL)0;
+    result = _objc_search_builtins(name);
+    if (result) return result;
+
+    *outHash = _objc_strhash(name);
+    if (_objc_selectors) {
+        result = __objc_sel_set_get_hashed(_objc_selectors, (SEL)name, *outHash);
+    }
+    return result;
+}
+
+/***********************************************************************
+* sel_registerNameHashedNoLock
+* sel_registerNameNoLock for a name whose hash was computed by 
+* sel_lookupNameNoLock.
+* Locking: selLock must be held for writing
+**********************************************************************/
+__private_extern__ SEL sel_registerNameHashedNoLock(const char *name, uint32_t hash, BOOL copy)
+{
+    SEL result;
+
+    rwlock_assert_writing(&selLock);
+
+    if (!name) return (SEL)0;
+    if (!_objc_selectors) {
+        _objc_selectors = __objc_sel_set_create(NUM_NONBUILTIN_SELS);
+    }
+    result = __objc_sel_set_get_hashed(_objc_selectors, (SEL)name, hash);
+    if (!result) {
+        result = (SEL)(copy ? _strdup_internal(name) : name);
+        __objc_sel_set_add_hashed(_objc_selectors, result, hash);
+    }
+    return result;
+}
+
 __private_extern__ void sel_lock(void)
 {
     rwlock_write(&selLock);
@@ -318,6 +382,10 @@ __private_extern__ void sel_init(BOOL wantsGC)
     s(retain);
     s(release);
     s(autorelease);
+    s(retainCount);
+    s(dealloc);
+    s(allowsWeakReference);
+    s(retainWeakReference);
     s(copy);
     s(finalize);
 